@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace async {
+    // Effect slot of a WavPlayer mix bus. Processes the bus accumulator in
+    // place before it is summed into the master, so samples are int32 and
+    // may exceed the 16-bit range.
+    class AudioEffect {
+    public:
+        virtual ~AudioEffect() {}
+        virtual void process(int32_t* samples, size_t count) = 0;
+
+        // True while output is still due from input already processed (a
+        // reverb or echo tail). The player keeps running the bus on silence,
+        // and keeps the output going, until it turns false.
+        virtual bool active() const { return false; }
+    };
+}
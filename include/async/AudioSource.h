@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace async {
+    // Decoder cost counters. Cycles are CPU cycles on ESP32 and 0 elsewhere.
+    struct DecodeStats {
+        uint32_t frames;
+        uint32_t lastCycles;
+        uint32_t maxCycles;
+        uint64_t totalCycles;
+        uint32_t syncErrors;
+        uint32_t underruns;
+    };
+
+    // Anything a WavPlayer track can pull mono 16-bit samples from
+    class AudioSource {
+    public:
+        static const size_t UNKNOWN_LENGTH = (size_t)-1;
+
+        virtual ~AudioSource() {}
+
+        // Reads up to frames samples, returns how many were produced. 0 means the end.
+        virtual size_t read(int16_t* samples, size_t frames) = 0;
+
+        // Frames left before the end, or UNKNOWN_LENGTH
+        virtual size_t remaining() const { return UNKNOWN_LENGTH; }
+
+        virtual bool rewind() { return false; }
+
+        // Sources that can wrap on their own (e.g. at loop points) return true
+        // and never end while looping; otherwise the player rewinds at the end.
+        virtual bool setLooping(bool enable) { return false; }
+
+        // Frames of digital silence ahead of the current position. The player
+        // skip()s whole silent blocks instead of reading and mixing them.
+        virtual size_t silentFrames() const { return 0; }
+
+        // Moves past up to frames samples without producing them, returns how many
+        virtual size_t skip(size_t frames) { return 0; }
+
+        // Called once the current block has gone to the output; decoders use
+        // it to work ahead of read() so their cost stays off the mix path
+        virtual void prefetch() {}
+
+        virtual bool getDecodeStats(DecodeStats& stats) const { return false; }
+
+        // Times the source has wrapped at its loop points by itself
+        virtual uint32_t getLoopCount() const { return 0; }
+
+        // Called when the player is done with the source: stopped, replaced by
+        // another play() or finished ahead of a queued one. Sources holding
+        // shared resources (e.g. cached samples) let go of them here.
+        virtual void release() {}
+    };
+}
@@ -1,126 +1,206 @@
 #pragma once
 
-#define NOTE_B0  31
-#define NOTE_C1  33
-#define NOTE_CS1 35
-#define NOTE_D1  37
-#define NOTE_DS1 39
-#define NOTE_E1  41
-#define NOTE_F1  44
-#define NOTE_FS1 46
-#define NOTE_G1  49
-#define NOTE_GS1 52
-#define NOTE_A1  55
-#define NOTE_AS1 58
-#define NOTE_B1  62
-#define NOTE_C2  65
-#define NOTE_CS2 69
-#define NOTE_D2  73
-#define NOTE_DS2 78
-#define NOTE_E2  82
-#define NOTE_F2  87
-#define NOTE_FS2 93
-#define NOTE_G2  98
-#define NOTE_GS2 104
-#define NOTE_A2  110
-#define NOTE_AS2 117
-#define NOTE_B2  123
-#define NOTE_C3  131
-#define NOTE_CS3 139
-#define NOTE_D3  147
-#define NOTE_DS3 156
-#define NOTE_E3  165
-#define NOTE_F3  175
-#define NOTE_FS3 185
-#define NOTE_G3  196
-#define NOTE_GS3 208
-#define NOTE_A3  220
-#define NOTE_AS3 233
-#define NOTE_B3  247
-#define NOTE_C4  262
-#define NOTE_CS4 277
-#define NOTE_D4  294
-#define NOTE_DS4 311
-#define NOTE_E4  330
-#define NOTE_F4  349
-#define NOTE_FS4 370
-#define NOTE_G4  392
-#define NOTE_GS4 415
-#define NOTE_A4  440
-#define NOTE_AS4 466
-#define NOTE_B4  494
-#define NOTE_C5  523
-#define NOTE_CS5 554
-#define NOTE_D5  587
-#define NOTE_DS5 622
-#define NOTE_E5  659
-#define NOTE_F5  698
-#define NOTE_FS5 740
-#define NOTE_G5  784
-#define NOTE_GS5 831
-#define NOTE_A5  880
-#define NOTE_AS5 932
-#define NOTE_B5  988
-#define NOTE_C6  1047
-#define NOTE_CS6 1109
-#define NOTE_D6  1175
-#define NOTE_DS6 1245
-#define NOTE_E6  1319
-#define NOTE_F6  1397
-#define NOTE_FS6 1480
-#define NOTE_G6  1568
-#define NOTE_GS6 1661
-#define NOTE_A6  1760
-#define NOTE_AS6 1865
-#define NOTE_B6  1976
-#define NOTE_C7  2093
-#define NOTE_CS7 2217
-#define NOTE_D7  2349
-#define NOTE_DS7 2489
-#define NOTE_E7  2637
-#define NOTE_F7  2794
-#define NOTE_FS7 2960
-#define NOTE_G7  3136
-#define NOTE_GS7 3322
-#define NOTE_A7  3520
-#define NOTE_AS7 3729
-#define NOTE_B7  3951
-#define NOTE_C8  4186
-#define NOTE_CS8 4435
-#define NOTE_D8  4699
-#define NOTE_DS8 4978
-
-
-
-
-// const int buzzerPin = 26;
-
-// // notes in the melody:
-// int melody[] = {
-//   NOTE_G7, NOTE_GS7, NOTE_G7, NOTE_F7, NOTE_G7, 0, NOTE_G7, NOTE_DS7
-// };
-
-
-// tone(buzzerPin, 3100, 100);
-// //delay(10000);
-
-// // note durations: 4 = quarter note, 8 = eighth note, etc.:
-// int noteDurations[] = {
-//   4, 8, 8, 4, 4, 4, 4, 4
-// };
-
-//   //pinMode(26, OUTPUT);
-//   //digitalWrite(26, HIGH);
-
-// for (int thisNote = 0; thisNote < 8; thisNote++) {
-//   // to calculate the note duration, take one second divided by the note type.
-//   //e.g. quarter note = 1000 / 4, eighth note = 1000/8, etc.
-//   int noteDuration = 1000 / noteDurations[thisNote];
-//   tone(buzzerPin, melody[thisNote], noteDuration);
-//   // to distinguish the notes, set a minimum time between them.
-//   // the note's duration + 30% seems to work well:
-//   int pauseBetweenNotes = noteDuration * 1.30;
-//   delay(pauseBetweenNotes);
-//   // stop the tone playing:
-//   noTone(buzzerPin);
-// }
\ No newline at end of file
+#include <stdint.h>
+#include <stddef.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+#include <async/Tick.h>
+#include <async/Notes.h>
+
+namespace async {
+    // Frequency 0 is a rest, duration is in milliseconds
+    struct BuzzerNote {
+        uint16_t frequency;
+        uint16_t duration;
+    };
+
+    // PWM peripheral and clock the Buzzer drives; the tone itself is timed in hardware
+    class BuzzerOutput {
+    public:
+        virtual ~BuzzerOutput() {}
+        virtual bool begin() { return true; }
+        virtual void end() {}
+        virtual void tone(uint32_t frequency) = 0;
+        virtual void silence() = 0;
+        virtual uint32_t now() = 0;
+    };
+
+#ifdef ESP32
+    class LedcBuzzerOutput : public BuzzerOutput {
+    private:
+        const uint8_t pin;
+        const uint8_t channel;
+
+    public:
+        LedcBuzzerOutput(uint8_t pin, uint8_t channel = 0) : pin(pin), channel(channel) {}
+
+        bool begin() override {
+            ledcSetup(channel, 2000, 8);
+            ledcAttachPin(pin, channel);
+            ledcWrite(channel, 0);
+            return true;
+        }
+
+        void end() override {
+            ledcWrite(channel, 0);
+            ledcDetachPin(pin);
+        }
+
+        void tone(uint32_t frequency) override {
+            ledcWriteTone(channel, frequency);
+        }
+
+        void silence() override {
+            ledcWrite(channel, 0);
+        }
+
+        uint32_t now() override {
+            return millis();
+        }
+    };
+#endif
+
+    // Stand-in for the PWM peripheral with a manually advanced clock, so
+    // sequences can be stepped and checked on a host build
+    class HostBuzzerOutput : public BuzzerOutput {
+    private:
+        uint32_t clock;
+        uint32_t frequency;
+        uint32_t changes;
+
+    public:
+        HostBuzzerOutput() : clock(0), frequency(0), changes(0) {}
+
+        void tone(uint32_t value) override {
+            frequency = value;
+            changes++;
+        }
+
+        void silence() override {
+            frequency = 0;
+            changes++;
+        }
+
+        uint32_t now() override {
+            return clock;
+        }
+
+        void advance(uint32_t ms) {
+            clock += ms;
+        }
+
+        uint32_t currentFrequency() const {
+            return frequency;
+        }
+
+        uint32_t changeCount() const {
+            return changes;
+        }
+    };
+
+    // Plays note sequences without blocking: tick() only checks whether the
+    // current note or the gap after it is over and moves to the next one.
+    class Buzzer : public Tick {
+    private:
+        BuzzerOutput* output;
+        const BuzzerNote* notes;
+        size_t count;
+        size_t index;
+        uint32_t deadline;
+        uint8_t gapPercent;
+        bool playing;
+        bool inGap;
+        bool repeat;
+        BuzzerNote single;
+
+        void startNote() {
+            const BuzzerNote& note = notes[index];
+            inGap = false;
+            deadline += note.duration;
+            if (note.frequency) {
+                output->tone(note.frequency);
+            } else {
+                output->silence();
+            }
+        }
+
+    public:
+        Buzzer(BuzzerOutput* output)
+            : output(output), notes(nullptr), count(0), index(0), deadline(0),
+            gapPercent(30), playing(false), inGap(false), repeat(false), single({0, 0}) {}
+
+        bool start() override {
+            return output->begin();
+        }
+
+        bool cancel() override {
+            stop();
+            output->end();
+            return true;
+        }
+
+        // Silence after each note as a percentage of its length, like the
+        // usual duration * 1.30 pause between notes
+        void setGap(uint8_t percent) {
+            gapPercent = percent;
+        }
+
+        // notes must stay valid while playing
+        void play(const BuzzerNote* sequence, size_t length, bool loop = false) {
+            if (!sequence || length == 0) return;
+            notes = sequence;
+            count = length;
+            index = 0;
+            repeat = loop;
+            playing = true;
+            deadline = output->now();
+            startNote();
+        }
+
+        void tone(uint16_t frequency, uint16_t duration) {
+            single.frequency = frequency;
+            single.duration = duration;
+            play(&single, 1);
+        }
+
+        void stop() {
+            if (!playing) return;
+            playing = false;
+            output->silence();
+        }
+
+        bool isPlaying() const {
+            return playing;
+        }
+
+        bool tick() {
+            if (!playing) return true;
+
+            // Deadlines advance by the scheduled lengths, so late ticks don't accumulate drift,
+            // and a sequence of zero-length notes can't spin here forever
+            uint32_t now = output->now();
+            size_t steps = 2 * count + 1;
+            while (playing && (int32_t)(now - deadline) >= 0 && steps-- > 0) {
+                if (!inGap) {
+                    uint32_t gap = (uint32_t)notes[index].duration * gapPercent / 100;
+                    inGap = true;
+                    deadline += gap;
+                    if (gap) output->silence();
+                    continue;
+                }
+
+                if (++index >= count) {
+                    if (!repeat) {
+                        // Also silences the last note when there is no gap after it
+                        stop();
+                        break;
+                    }
+                    index = 0;
+                }
+                startNote();
+            }
+            return true;
+        }
+    };
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace async {
+    // Requantizer state carried from one block to the next
+    struct DacDither {
+        bool noiseShaping;
+        int32_t error;
+        uint32_t seed;
+
+        DacDither(bool shaping = true) : noiseShaping(shaping), error(0), seed(1) {}
+
+        void reset() {
+            error = 0;
+        }
+    };
+
+    // 16 to 8 bits for the built-in DAC, in the high byte of an unsigned
+    // sample duplicated into both channels (out holds count * 2). Triangular
+    // dither (two 8-bit uniforms from one LCG step) decorrelates the error;
+    // feeding it back into the next sample shapes it with 1 - z^-1, moving
+    // it from the audible band towards Nyquist. Without noise shaping it
+    // rounds plainly.
+    inline void packDac(const int16_t* samples, uint16_t* out, size_t count, DacDither& state) {
+        int32_t error = state.error;
+        uint32_t seed = state.seed;
+        for (size_t i = 0; i < count; i++) {
+            int32_t value = samples[i] + error;
+            int32_t level;
+            if (state.noiseShaping) {
+                seed = seed * 1664525u + 1013904223u;
+                int32_t dither = (int32_t)((seed >> 24) & 0xFF) + (int32_t)((seed >> 16) & 0xFF) - 255;
+                level = (value + dither + 128) >> 8;
+            } else {
+                level = (value + 128) >> 8;
+            }
+            if (level > 127) level = 127;
+            if (level < -128) level = -128;
+
+            // Clipping would wind the error up; keep it within two steps
+            error = 0;
+            if (state.noiseShaping) {
+                error = value - level * 256;
+                if (error > 512) error = 512;
+                if (error < -512) error = -512;
+            }
+            uint16_t sample = (uint16_t)((level + 128) << 8);
+            out[i * 2] = sample;
+            out[i * 2 + 1] = sample;
+        }
+        state.error = error;
+        state.seed = seed;
+    }
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <Arduino.h>
+#include <new>
+#include <async/Stream.h>
+#include <async/AudioSource.h>
+
+// Codecs are compiled in unless stripped with ASYNC_AUDIO_NO_WAV,
+// ASYNC_AUDIO_NO_QOA, ASYNC_AUDIO_NO_MP3 or ASYNC_AUDIO_NO_RAW. MP3 also
+// needs the Helix decoder to be available.
+#ifndef ASYNC_AUDIO_NO_WAV
+#include <async/WavSource.h>
+#endif
+#ifndef ASYNC_AUDIO_NO_QOA
+#include <async/QoaSource.h>
+#endif
+#ifndef ASYNC_AUDIO_NO_MP3
+#include <async/Mp3Source.h>
+#endif
+
+namespace async {
+    enum AudioFormat {
+        FORMAT_UNKNOWN,
+        FORMAT_WAV,
+        FORMAT_QOA,
+        FORMAT_MP3,
+        FORMAT_RAW
+    };
+
+    // Headerless data has nothing to sniff, so the caller describes it
+    struct RawFormat {
+        uint32_t sampleRate;
+        size_t offset;
+        size_t frames;      // 0 reads to the end of the stream
+    };
+
+#ifndef ASYNC_AUDIO_NO_RAW
+    // Mono 16-bit little-endian PCM at a known offset of a Stream
+    class RawSource : public AudioSource {
+    private:
+        Stream* stream;
+        size_t offset;
+        size_t frames;
+        size_t position;
+
+    public:
+        RawSource() : stream(nullptr), offset(0), frames(0), position(0) {}
+
+        bool open(Stream* source, const RawFormat& format) {
+            stream = source;
+            offset = format.offset;
+            frames = format.frames;
+            return rewind();
+        }
+
+        size_t read(int16_t* samples, size_t count) override {
+            if (!stream) return 0;
+            if (frames) count = min(count, frames - position);
+            size_t got = stream->read(reinterpret_cast<char*>(samples), count * sizeof(int16_t)) / sizeof(int16_t);
+            position += got;
+            return got;
+        }
+
+        size_t remaining() const override {
+            if (!stream) return 0;
+            return frames ? frames - position : UNKNOWN_LENGTH;
+        }
+
+        bool rewind() override {
+            if (!stream) return false;
+            stream->seek(offset);
+            position = 0;
+            return true;
+        }
+    };
+#endif
+
+    namespace Decoders {
+        static const size_t SNIFF_SIZE = 22;
+
+        // Identifies a stream from its first bytes. RIFF/WAVE is only
+        // accepted with PCM in a leading fmt chunk.
+        inline AudioFormat sniff(const uint8_t* head, size_t length) {
+            if (length >= 12 && memcmp(head, "RIFF", 4) == 0 && memcmp(head + 8, "WAVE", 4) == 0) {
+                if (length >= SNIFF_SIZE && memcmp(head + 12, "fmt ", 4) == 0 && (head[20] | (head[21] << 8)) != 1) {
+                    return FORMAT_UNKNOWN;
+                }
+                return FORMAT_WAV;
+            }
+            if (length >= 4 && memcmp(head, "qoaf", 4) == 0) return FORMAT_QOA;
+            if (length >= 3 && memcmp(head, "ID3", 3) == 0) return FORMAT_MP3;
+            if (length >= 2 && head[0] == 0xFF && (head[1] & 0xE0) == 0xE0) return FORMAT_MP3;
+            return FORMAT_UNKNOWN;
+        }
+
+        inline bool supported(AudioFormat format) {
+            switch (format) {
+#ifndef ASYNC_AUDIO_NO_WAV
+                case FORMAT_WAV: return true;
+#endif
+#ifndef ASYNC_AUDIO_NO_QOA
+                case FORMAT_QOA: return true;
+#endif
+#if !defined(ASYNC_AUDIO_NO_MP3) && defined(ASYNC_AUDIO_MP3)
+                case FORMAT_MP3: return true;
+#endif
+#ifndef ASYNC_AUDIO_NO_RAW
+                case FORMAT_RAW: return true;
+#endif
+                default: return false;
+            }
+        }
+    }
+
+    // Storage for one decoder of any compiled-in format. Opening a stream
+    // sniffs it and constructs the matching decoder in place, so switching
+    // formats never touches the heap. A slot is the size of the largest
+    // decoder object, ~100 bytes; MP3's codec buffers are not in it but
+    // borrowed from the fixed pool bounded by ASYNC_AUDIO_MP3_DECODERS.
+    class DecoderSlot {
+    private:
+        union Storage {
+#ifndef ASYNC_AUDIO_NO_WAV
+            char wav[sizeof(WavSource)];
+#endif
+#ifndef ASYNC_AUDIO_NO_QOA
+            char qoa[sizeof(QoaSource)];
+#endif
+#if !defined(ASYNC_AUDIO_NO_MP3) && defined(ASYNC_AUDIO_MP3)
+            char mp3[sizeof(Mp3Source)];
+#endif
+#ifndef ASYNC_AUDIO_NO_RAW
+            char raw[sizeof(RawSource)];
+#endif
+            void* align;
+            uint64_t align64;
+        };
+
+        Storage storage;
+        AudioSource* source;
+        AudioFormat format;
+
+        template <typename T>
+        T* construct() {
+            T* decoder = new (&storage) T();
+            source = decoder;
+            return decoder;
+        }
+
+    public:
+        DecoderSlot() : source(nullptr), format(FORMAT_UNKNOWN) {}
+
+        DecoderSlot(const DecoderSlot&) = delete;
+        DecoderSlot& operator=(const DecoderSlot&) = delete;
+
+        ~DecoderSlot() {
+            release();
+        }
+
+        // Returns the opened decoder, or nullptr for unknown, stripped or broken
+        // streams. A sampleRate rejects files of any format at another rate.
+        AudioSource* open(Stream* stream, uint32_t sampleRate = 0) {
+            release();
+            if (!stream) return nullptr;
+
+            uint8_t head[Decoders::SNIFF_SIZE];
+            stream->seek(0);
+            size_t length = stream->read(reinterpret_cast<char*>(head), sizeof(head));
+            AudioFormat sniffed = Decoders::sniff(head, length);
+
+            bool opened = false;
+            switch (sniffed) {
+#ifndef ASYNC_AUDIO_NO_WAV
+                case FORMAT_WAV: opened = construct<WavSource>()->open(stream, sampleRate); break;
+#endif
+#ifndef ASYNC_AUDIO_NO_QOA
+                case FORMAT_QOA: opened = construct<QoaSource>()->open(stream, sampleRate); break;
+#endif
+#if !defined(ASYNC_AUDIO_NO_MP3) && defined(ASYNC_AUDIO_MP3)
+                case FORMAT_MP3: opened = construct<Mp3Source>()->open(stream, sampleRate); break;
+#endif
+                default: break;
+            }
+
+            format = sniffed;
+            if (!opened) release();
+            return source;
+        }
+
+#ifndef ASYNC_AUDIO_NO_RAW
+        AudioSource* open(Stream* stream, const RawFormat& raw) {
+            release();
+            if (!stream) return nullptr;
+            format = FORMAT_RAW;
+            if (!construct<RawSource>()->open(stream, raw)) release();
+            return source;
+        }
+#endif
+
+        void release() {
+            if (source) source->~AudioSource();
+            source = nullptr;
+            format = FORMAT_UNKNOWN;
+        }
+
+        AudioSource* get() const {
+            return source;
+        }
+
+        AudioFormat getFormat() const {
+            return source ? format : FORMAT_UNKNOWN;
+        }
+    };
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+
+namespace async {
+    // Look-ahead peak limiter for the master bus. Works on the int32 mix
+    // accumulator and packs straight to int16, so it replaces the final
+    // saturation pass instead of adding another one.
+    class Limiter {
+    public:
+        static const size_t MAX_LOOKAHEAD = 64;
+
+    private:
+        int32_t delayLine[MAX_LOOKAHEAD];
+        size_t delayPos;
+        size_t lookahead;
+        int32_t threshold;
+        int32_t attackCoef;
+        int32_t releaseCoef;
+        int32_t heldPeak;
+        size_t holdCount;
+        int32_t gain;
+        int32_t targetGain;
+        int32_t attackStep;
+
+        static int32_t coefficient(float ms, uint32_t sampleRate) {
+            float samples = ms * sampleRate / 1000.0f;
+            if (samples < 1.0f) return 1 << 15;
+            return (int32_t)((1.0f - expf(-1.0f / samples)) * (1 << 15));
+        }
+
+    public:
+        Limiter() : delayPos(0), lookahead(0), threshold(INT16_MAX), attackCoef(1 << 15),
+            releaseCoef(1 << 15), heldPeak(0), holdCount(0), gain(1 << 15), targetGain(1 << 15), attackStep(0) {
+            reset();
+        }
+
+        void configure(uint32_t sampleRate, float thresholdLevel, float attackMs, float releaseMs, float lookaheadMs) {
+            threshold = (int32_t)(constrain(thresholdLevel, 0.01f, 1.0f) * INT16_MAX);
+            attackCoef = coefficient(attackMs, sampleRate);
+            releaseCoef = coefficient(releaseMs, sampleRate);
+            lookahead = (size_t)(max(lookaheadMs, 0.0f) * sampleRate / 1000.0f);
+            if (lookahead > MAX_LOOKAHEAD) lookahead = MAX_LOOKAHEAD;
+            reset();
+        }
+
+        void reset() {
+            memset(delayLine, 0, sizeof(delayLine));
+            delayPos = 0;
+            heldPeak = 0;
+            holdCount = 0;
+            gain = 1 << 15;
+            targetGain = 1 << 15;
+            attackStep = 0;
+        }
+
+        // Audio still in the look-ahead delay line, due out after the input stops
+        bool holding() const {
+            for (size_t i = 0; i < lookahead; i++) {
+                if (delayLine[i] != 0) return true;
+            }
+            return false;
+        }
+
+        // Linear ramp that lands on targetGain by the time the peak that set
+        // it leaves the delay line; never slower than a ramp already running
+        void scheduleAttack() {
+            if (targetGain >= gain) return;
+            int32_t window = lookahead > 0 ? (int32_t)lookahead : 1;
+            int32_t step = (gain - targetGain + window - 1) / window;
+            if (step > attackStep) attackStep = step;
+        }
+
+        void process(const int32_t* in, int16_t* out, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                int32_t sample = in[i];
+                int32_t peak = sample < 0 ? -sample : sample;
+
+                // Hold each peak for the look-ahead window, then let it decay
+                if (peak >= heldPeak) {
+                    heldPeak = peak;
+                    holdCount = lookahead;
+                    targetGain = heldPeak > threshold ? (int32_t)(((int64_t)threshold << 15) / heldPeak) : (1 << 15);
+                    scheduleAttack();
+                } else if (holdCount > 0) {
+                    holdCount--;
+                } else if (heldPeak > threshold) {
+                    heldPeak -= (int32_t)(((int64_t)(heldPeak - peak) * releaseCoef) >> 15) + 1;
+                    targetGain = heldPeak > threshold ? (int32_t)(((int64_t)threshold << 15) / heldPeak) : (1 << 15);
+                }
+
+                // The one-pole attack only matters when it is faster than the ramp
+                if (targetGain < gain) {
+                    int32_t step = (int32_t)(((int64_t)(gain - targetGain) * attackCoef) >> 15) + 1;
+                    gain -= max(step, attackStep);
+                    if (gain <= targetGain) {
+                        gain = targetGain;
+                        attackStep = 0;
+                    }
+                } else if (targetGain > gain) {
+                    attackStep = 0;
+                    gain += (int32_t)(((int64_t)(targetGain - gain) * releaseCoef) >> 15) + 1;
+                    if (gain > targetGain) gain = targetGain;
+                }
+
+                int32_t delayed = sample;
+                if (lookahead > 0) {
+                    delayed = delayLine[delayPos];
+                    delayLine[delayPos] = sample;
+                    if (++delayPos >= lookahead) delayPos = 0;
+                }
+
+                int32_t limited = (int32_t)(((int64_t)delayed * gain) >> 15);
+                if (limited > INT16_MAX) limited = INT16_MAX;
+                else if (limited < INT16_MIN) limited = INT16_MIN;
+                out[i] = (int16_t)limited;
+            }
+        }
+    };
+}
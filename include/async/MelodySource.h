@@ -0,0 +1,123 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/AudioSource.h>
+#include <async/ToneSource.h>
+#include <async/Buzzer.h>
+#include <async/Rtttl.h>
+
+namespace async {
+    // Plays a BuzzerNote sequence (e.g. a compiled Melody) on a WavPlayer track
+    // through a ToneSource, with the same note/gap timing as Buzzer.
+    class MelodySource : public AudioSource {
+    private:
+        ToneSource tone;
+        const BuzzerNote* notes;
+        size_t count;
+        size_t index;
+        uint8_t gapPercent;
+        bool inGap;
+        bool repeat;
+        float level;
+
+        uint32_t stepDuration() const {
+            const BuzzerNote& note = notes[index];
+            return inGap ? (uint32_t)note.duration * gapPercent / 100 : note.duration;
+        }
+
+        // Moves to the next note or gap; false at the end of the sequence
+        bool step() {
+            if (!inGap && gapPercent > 0) {
+                inGap = true;
+                return true;
+            }
+            inGap = false;
+            if (++index >= count) {
+                if (!repeat) return false;
+                index = 0;
+            }
+            return true;
+        }
+
+        // Starts the current step, skipping zero-length ones (ToneSource would
+        // play a 0 ms tone forever). A melody of nothing but those ends.
+        bool startStep() {
+            for (size_t tries = 0; tries <= 2 * count; tries++) {
+                uint32_t duration = stepDuration();
+                if (duration > 0) {
+                    tone.tone(inGap ? 0 : notes[index].frequency, duration, inGap ? 0.0f : level);
+                    return true;
+                }
+                if (!step()) break;
+            }
+            index = count;
+            return false;
+        }
+
+        bool advance() {
+            if (index >= count) return false;
+            if (!step()) return false;
+            return startStep();
+        }
+
+    public:
+        MelodySource(uint32_t sampleRate = 32000, Waveform waveform = WAVE_SQUARE)
+            : tone(sampleRate, waveform), notes(nullptr), count(0), index(0),
+            gapPercent(30), inGap(false), repeat(false), level(0.5f) {}
+
+        // notes must stay valid while playing
+        void setMelody(const BuzzerNote* sequence, size_t length) {
+            notes = sequence;
+            count = sequence ? length : 0;
+            rewind();
+        }
+
+        template <size_t N>
+        void setMelody(const Melody<N>& melody) {
+            setMelody(melody.notes(), melody.size());
+        }
+
+        void setWaveform(Waveform waveform) {
+            tone.setWaveform(waveform);
+        }
+
+        void setLevel(float value) {
+            level = constrain(value, 0.0f, 1.0f);
+        }
+
+        // Silence after each note as a percentage of its length; 30 by
+        // default, as on Buzzer
+        void setGap(uint8_t percent) {
+            gapPercent = percent;
+        }
+
+        size_t read(int16_t* samples, size_t frames) override {
+            if (index >= count) return 0;
+
+            size_t total = 0;
+            size_t idle = 0;
+            while (total < frames) {
+                size_t got = tone.read(samples + total, frames - total);
+                total += got;
+                if (got > 0) {
+                    idle = 0;
+                    continue;
+                }
+                // Steps shorter than a frame produce nothing; give up after a full pass of them
+                if (++idle > 2 * count + 1 || !advance()) break;
+            }
+            return total;
+        }
+
+        bool rewind() override {
+            index = 0;
+            inGap = false;
+            return count > 0 && startStep();
+        }
+
+        bool setLooping(bool enable) override {
+            repeat = enable;
+            return true;
+        }
+    };
+}
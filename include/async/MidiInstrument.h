@@ -0,0 +1,16 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/AudioSource.h>
+
+namespace async {
+    // A sound generator a MidiPlayer can drive: channel messages in, audio out
+    // through the AudioSource read(). Instruments never end on their own.
+    class MidiInstrument : public AudioSource {
+    public:
+        virtual void noteOn(uint8_t channel, uint8_t note, uint8_t velocity) = 0;
+        virtual void noteOff(uint8_t channel, uint8_t note) = 0;
+        virtual void programChange(uint8_t channel, uint8_t program) {}
+        virtual void allNotesOff() = 0;
+    };
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/AudioSource.h>
+#include <async/MidiInstrument.h>
+
+namespace async {
+    // Standard MIDI File (type 0/1) sequencer that renders through a
+    // MidiInstrument, e.g. a Synth or a Sampler. The file is parsed in place
+    // from memory. Events land on exact output samples: the instrument is
+    // rendered up to each event, and the tick-to-sample conversion carries
+    // its remainder, so tempo changes never accumulate drift.
+    class MidiPlayer : public AudioSource {
+    public:
+        static const int MAX_TRACKS = 16;
+
+    private:
+        struct TrackCursor {
+            const uint8_t* start;
+            const uint8_t* position;
+            const uint8_t* end;
+            uint32_t nextTick;
+            uint8_t runningStatus;
+            bool finished;
+        };
+
+        MidiInstrument* instrument;
+        const uint32_t sampleRate;
+        TrackCursor tracks[MAX_TRACKS];
+        int trackCount;
+        uint16_t division;
+        uint32_t tempo;
+        uint32_t currentTick;
+        uint32_t samplesToEvent;
+        uint64_t sampleRemainder;
+        size_t tailFrames;
+        size_t tailLeft;
+        bool repeat;
+        bool ended;
+
+        static uint32_t readBE32(const uint8_t* p) {
+            return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+        }
+
+        static uint16_t readBE16(const uint8_t* p) {
+            return (p[0] << 8) | p[1];
+        }
+
+        static uint32_t readVarLen(const uint8_t*& p, const uint8_t* end) {
+            uint32_t value = 0;
+            for (int i = 0; i < 4 && p < end; i++) {
+                uint8_t byte = *p++;
+                value = (value << 7) | (byte & 0x7F);
+                if (!(byte & 0x80)) break;
+            }
+            return value;
+        }
+
+        void scheduleNext(TrackCursor& track) {
+            if (track.position >= track.end) {
+                track.finished = true;
+                return;
+            }
+            track.nextTick += readVarLen(track.position, track.end);
+        }
+
+        // Ticks to samples at the current tempo, carrying the remainder
+        uint32_t ticksToSamples(uint32_t ticks) {
+            if (division & 0x8000) {
+                // SMPTE: frames per second times ticks per frame
+                uint64_t ticksPerSecond = (uint64_t)(uint8_t)(-(int8_t)(division >> 8)) * (division & 0xFF);
+                uint64_t numerator = (uint64_t)ticks * sampleRate + sampleRemainder;
+                sampleRemainder = numerator % ticksPerSecond;
+                return (uint32_t)(numerator / ticksPerSecond);
+            }
+            uint64_t denominator = 1000000ULL * division;
+            uint64_t numerator = (uint64_t)ticks * tempo * sampleRate + sampleRemainder;
+            sampleRemainder = numerator % denominator;
+            return (uint32_t)(numerator / denominator);
+        }
+
+        void dispatch(TrackCursor& track) {
+            const uint8_t*& p = track.position;
+            if (p >= track.end) {
+                track.finished = true;
+                return;
+            }
+
+            uint8_t status = *p;
+            if (status & 0x80) {
+                p++;
+                if (status < 0xF0) track.runningStatus = status;
+            } else {
+                status = track.runningStatus;
+            }
+
+            if (status == 0xFF) {
+                uint8_t type = p < track.end ? *p++ : 0x2F;
+                uint32_t size = readVarLen(p, track.end);
+                if (type == 0x51 && size == 3 && p + 3 <= track.end) {
+                    tempo = ((uint32_t)p[0] << 16) | (p[1] << 8) | p[2];
+                } else if (type == 0x2F) {
+                    track.finished = true;
+                    return;
+                }
+                p += min((size_t)size, (size_t)(track.end - p));
+            } else if (status == 0xF0 || status == 0xF7) {
+                uint32_t size = readVarLen(p, track.end);
+                p += min((size_t)size, (size_t)(track.end - p));
+            } else {
+                uint8_t kind = status & 0xF0;
+                uint8_t channel = status & 0x0F;
+                int dataBytes = (kind == 0xC0 || kind == 0xD0) ? 1 : 2;
+                if (track.end - p < dataBytes || !(status & 0x80)) {
+                    track.finished = true;
+                    return;
+                }
+                uint8_t a = p[0] & 0x7F;
+                uint8_t b = dataBytes > 1 ? p[1] & 0x7F : 0;
+                p += dataBytes;
+
+                if (kind == 0x90) {
+                    instrument->noteOn(channel, a, b);
+                } else if (kind == 0x80) {
+                    instrument->noteOff(channel, a);
+                } else if (kind == 0xC0) {
+                    instrument->programChange(channel, a);
+                } else if (kind == 0xB0 && (a == 120 || a == 123)) {
+                    instrument->allNotesOff();
+                }
+            }
+
+            scheduleNext(track);
+        }
+
+        // Plays every event due at the current tick and times the next one.
+        // Returns false once all tracks are finished.
+        bool advance() {
+            while (true) {
+                uint32_t nextTick = UINT32_MAX;
+                for (int i = 0; i < trackCount; i++) {
+                    if (!tracks[i].finished && tracks[i].nextTick < nextTick) nextTick = tracks[i].nextTick;
+                }
+                if (nextTick == UINT32_MAX) return false;
+
+                if (nextTick > currentTick) {
+                    samplesToEvent = ticksToSamples(nextTick - currentTick);
+                    currentTick = nextTick;
+                    if (samplesToEvent > 0) return true;
+                }
+
+                for (int i = 0; i < trackCount; i++) {
+                    TrackCursor& track = tracks[i];
+                    while (!track.finished && track.nextTick == currentTick) dispatch(track);
+                }
+            }
+        }
+
+    public:
+        MidiPlayer(MidiInstrument* instrument, uint32_t sampleRate = 32000)
+            : instrument(instrument), sampleRate(sampleRate), trackCount(0),
+            division(96), tempo(500000), currentTick(0), samplesToEvent(0), sampleRemainder(0),
+            tailFrames(sampleRate / 2), tailLeft(0), repeat(false), ended(true) {}
+
+        // Parses the header and locates the tracks; data must stay valid while playing
+        bool open(const uint8_t* file, size_t size) {
+            trackCount = 0;
+
+            if (!file || size < 14 || memcmp(file, "MThd", 4) != 0) return false;
+            uint32_t headerSize = readBE32(file + 4);
+            uint16_t format = readBE16(file + 8);
+            uint16_t declared = readBE16(file + 10);
+            division = readBE16(file + 12);
+            if (format > 1 || headerSize < 6 || headerSize > size - 8 || division == 0) return false;
+
+            size_t offset = 8 + headerSize;
+            while (offset + 8 <= size && trackCount < MAX_TRACKS && trackCount < declared) {
+                uint32_t chunkSize = readBE32(file + offset + 4);
+                const uint8_t* start = file + offset + 8;
+                size_t available = size - offset - 8;
+                if (memcmp(file + offset, "MTrk", 4) == 0) {
+                    tracks[trackCount].start = start;
+                    tracks[trackCount].end = start + min((size_t)chunkSize, available);
+                    trackCount++;
+                }
+                // A chunk running past the end (truncated file) is the last one
+                if (chunkSize > available) break;
+                offset += 8 + chunkSize;
+            }
+
+            if (trackCount == 0) return false;
+            rewind();
+            return true;
+        }
+
+        // Instrument release time rendered after the last event
+        void setTail(float ms) {
+            tailFrames = (size_t)(max(ms, 0.0f) * sampleRate / 1000.0f);
+        }
+
+        size_t read(int16_t* samples, size_t frames) override {
+            size_t done = 0;
+
+            while (done < frames) {
+                if (ended) {
+                    if (tailLeft == 0) break;
+                    size_t chunk = min(frames - done, tailLeft);
+                    done += instrument->read(samples + done, chunk);
+                    tailLeft -= chunk;
+                    continue;
+                }
+
+                if (samplesToEvent == 0 && !advance()) {
+                    if (repeat) {
+                        rewind();
+                        if (!advance()) {
+                            ended = true;
+                            tailLeft = tailFrames;
+                        }
+                    } else {
+                        ended = true;
+                        tailLeft = tailFrames;
+                    }
+                    continue;
+                }
+
+                size_t chunk = min((size_t)samplesToEvent, frames - done);
+                done += instrument->read(samples + done, chunk);
+                samplesToEvent -= chunk;
+            }
+            return done;
+        }
+
+        bool rewind() override {
+            if (trackCount == 0) return false;
+            instrument->allNotesOff();
+            tempo = 500000;
+            currentTick = 0;
+            samplesToEvent = 0;
+            sampleRemainder = 0;
+            tailLeft = 0;
+            ended = false;
+
+            for (int i = 0; i < trackCount; i++) {
+                TrackCursor& track = tracks[i];
+                track.position = track.start;
+                track.runningStatus = 0;
+                track.nextTick = 0;
+                track.finished = false;
+                scheduleNext(track);
+            }
+            return true;
+        }
+
+        bool setLooping(bool enable) override {
+            repeat = enable;
+            return true;
+        }
+    };
+}
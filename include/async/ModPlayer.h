@@ -0,0 +1,453 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+#include <async/AudioSource.h>
+
+namespace async {
+    // ProTracker-style MOD player (M.K./FLT4/xCHN, up to 8 channels, 31
+    // samples) as a WavPlayer source. Sample data is read in place from the
+    // module; channels are resampled with a Q16.16 position and linear
+    // interpolation and summed in int32 like regular tracks.
+    class ModPlayer : public AudioSource {
+    public:
+        static const int MAX_CHANNELS = 8;
+
+    private:
+        static const int SAMPLE_COUNT = 31;
+        static const int ROWS = 64;
+        static const int MIN_PERIOD = 113;
+        static const int MAX_PERIOD = 856;
+
+        struct ModSample {
+            const int8_t* data;
+            uint32_t length;
+            uint32_t loopStart;
+            uint32_t loopLength;
+            int8_t finetune;
+            uint8_t volume;
+        };
+
+        struct Channel {
+            const ModSample* sample;
+            uint32_t position;
+            uint32_t fraction;
+            uint32_t step;
+            int period;
+            int targetPeriod;
+            int volume;
+            uint8_t effect;
+            uint8_t param;
+            uint8_t portaSpeed;
+            uint8_t vibratoParam;
+            uint8_t vibratoPos;
+            uint8_t loopRow;
+            uint8_t loopCount;
+        };
+
+        const uint8_t* patterns;
+        const uint8_t* orders;
+        ModSample samples[SAMPLE_COUNT];
+        Channel channels[MAX_CHANNELS];
+        const uint32_t sampleRate;
+        uint32_t clockStep;
+        int channelCount;
+        uint8_t songLength;
+        uint8_t restartOrder;
+        uint8_t order;
+        uint8_t row;
+        uint8_t tick;
+        uint8_t speed;
+        uint8_t tempo;
+        int breakOrder;
+        int breakRow;
+        uint32_t tickSamples;
+        uint32_t tickLeft;
+        int32_t masterGain;
+        bool repeat;
+        bool ended;
+
+        static uint16_t readBE16(const uint8_t* p) {
+            return (p[0] << 8) | p[1];
+        }
+
+        static int finetuned(int period, int8_t finetune) {
+            if (finetune == 0) return period;
+            return (int)(period * powf(2.0f, -finetune / 96.0f) + 0.5f);
+        }
+
+        // Period divisor for a semitone offset, Q16
+        static uint32_t semitoneFactor(int semitones) {
+            static const uint32_t factors[16] = {
+                65536, 61858, 58386, 55109, 52016, 49097, 46341, 43740,
+                41285, 38968, 36781, 34716, 32768, 30929, 29193, 27554
+            };
+            return factors[semitones & 15];
+        }
+
+        static int vibratoTable(int position) {
+            static const uint8_t table[32] = {
+                0, 24, 49, 74, 97, 120, 141, 161, 180, 197, 212, 224, 235, 244, 250, 253,
+                255, 253, 250, 244, 235, 224, 212, 197, 180, 161, 141, 120, 97, 74, 49, 24
+            };
+            return (position & 32) ? -table[position & 31] : table[position & 31];
+        }
+
+        void setStep(Channel& channel, int period) {
+            if (period <= 0) {
+                channel.step = 0;
+                return;
+            }
+            channel.step = clockStep / period;
+        }
+
+        void setTiming() {
+            // 125 BPM is 50 ticks per second
+            tickSamples = (uint32_t)((uint64_t)sampleRate * 5 / (tempo * 2));
+        }
+
+        void processRow() {
+            const uint8_t* cells = patterns + ((size_t)orders[order] * ROWS + row) * channelCount * 4;
+
+            for (int c = 0; c < channelCount; c++) {
+                Channel& channel = channels[c];
+                const uint8_t* cell = cells + c * 4;
+                int instrument = (cell[0] & 0xF0) | (cell[2] >> 4);
+                int period = ((cell[0] & 0x0F) << 8) | cell[1];
+                uint8_t effect = cell[2] & 0x0F;
+                uint8_t param = cell[3];
+
+                if (instrument > 0 && instrument <= SAMPLE_COUNT) {
+                    channel.sample = &samples[instrument - 1];
+                    channel.volume = channel.sample->volume;
+                }
+
+                if (period > 0 && channel.sample) {
+                    period = finetuned(period, channel.sample->finetune);
+                    if (effect == 0x3 || effect == 0x5) {
+                        channel.targetPeriod = period;
+                    } else {
+                        channel.period = period;
+                        channel.position = 0;
+                        channel.fraction = 0;
+                        channel.vibratoPos = 0;
+                        if (effect == 0x9) channel.position = (uint32_t)param << 8;
+                    }
+                }
+
+                channel.effect = effect;
+                channel.param = param;
+
+                switch (effect) {
+                    case 0x3:
+                        if (param) channel.portaSpeed = param;
+                        break;
+                    case 0x4:
+                        if (param & 0x0F) channel.vibratoParam = (channel.vibratoParam & 0xF0) | (param & 0x0F);
+                        if (param & 0xF0) channel.vibratoParam = (channel.vibratoParam & 0x0F) | (param & 0xF0);
+                        break;
+                    case 0xB:
+                        breakOrder = param;
+                        if (breakRow < 0) breakRow = 0;
+                        break;
+                    case 0xC:
+                        channel.volume = min((int)param, 64);
+                        break;
+                    case 0xD:
+                        breakRow = min((param >> 4) * 10 + (param & 0x0F), (int)ROWS - 1);
+                        if (breakOrder < 0) breakOrder = order + 1;
+                        break;
+                    case 0xE:
+                        processExtended(channel, param >> 4, param & 0x0F);
+                        break;
+                    case 0xF:
+                        if (param == 0) break;
+                        if (param < 32) {
+                            speed = param;
+                        } else {
+                            tempo = param;
+                            setTiming();
+                        }
+                        break;
+                }
+
+                setStep(channel, channel.period);
+            }
+        }
+
+        void processExtended(Channel& channel, uint8_t command, uint8_t value) {
+            switch (command) {
+                case 0x1:
+                    channel.period = max(channel.period - value, (int)MIN_PERIOD);
+                    break;
+                case 0x2:
+                    channel.period = min(channel.period + value, (int)MAX_PERIOD);
+                    break;
+                case 0x6:
+                    if (value == 0) {
+                        channel.loopRow = row;
+                    } else if (channel.loopCount == 0) {
+                        channel.loopCount = value;
+                        breakOrder = order;
+                        breakRow = channel.loopRow;
+                    } else if (--channel.loopCount > 0) {
+                        breakOrder = order;
+                        breakRow = channel.loopRow;
+                    }
+                    break;
+                case 0xA:
+                    channel.volume = min(channel.volume + value, 64);
+                    break;
+                case 0xB:
+                    channel.volume = max(channel.volume - value, 0);
+                    break;
+            }
+        }
+
+        void volumeSlide(Channel& channel, uint8_t param) {
+            if (param & 0xF0) {
+                channel.volume = min(channel.volume + (param >> 4), 64);
+            } else {
+                channel.volume = max(channel.volume - (param & 0x0F), 0);
+            }
+        }
+
+        void tonePortamento(Channel& channel) {
+            if (channel.targetPeriod <= 0) return;
+            if (channel.period < channel.targetPeriod) {
+                channel.period = min(channel.period + channel.portaSpeed, channel.targetPeriod);
+            } else if (channel.period > channel.targetPeriod) {
+                channel.period = max(channel.period - channel.portaSpeed, channel.targetPeriod);
+            }
+        }
+
+        int vibrato(Channel& channel) {
+            int delta = (vibratoTable(channel.vibratoPos) * (channel.vibratoParam & 0x0F)) >> 7;
+            channel.vibratoPos = (channel.vibratoPos + (channel.vibratoParam >> 4)) & 63;
+            return channel.period + delta;
+        }
+
+        // Effects that run on every tick but the first of a row
+        void processTickEffects() {
+            for (int c = 0; c < channelCount; c++) {
+                Channel& channel = channels[c];
+                int period = channel.period;
+
+                switch (channel.effect) {
+                    case 0x0:
+                        if (channel.param) {
+                            int semitones = tick % 3 == 1 ? channel.param >> 4 : tick % 3 == 2 ? channel.param & 0x0F : 0;
+                            period = (int)(((uint32_t)channel.period * semitoneFactor(semitones)) >> 16);
+                        }
+                        break;
+                    case 0x1:
+                        channel.period = max(channel.period - channel.param, (int)MIN_PERIOD);
+                        period = channel.period;
+                        break;
+                    case 0x2:
+                        channel.period = min(channel.period + channel.param, (int)MAX_PERIOD);
+                        period = channel.period;
+                        break;
+                    case 0x3:
+                        tonePortamento(channel);
+                        period = channel.period;
+                        break;
+                    case 0x4:
+                        period = vibrato(channel);
+                        break;
+                    case 0x5:
+                        tonePortamento(channel);
+                        volumeSlide(channel, channel.param);
+                        period = channel.period;
+                        break;
+                    case 0x6:
+                        volumeSlide(channel, channel.param);
+                        period = vibrato(channel);
+                        break;
+                    case 0xA:
+                        volumeSlide(channel, channel.param);
+                        break;
+                    case 0xE:
+                        if ((channel.param >> 4) == 0xC && tick == (channel.param & 0x0F)) channel.volume = 0;
+                        break;
+                }
+
+                setStep(channel, period);
+            }
+        }
+
+        void nextRow() {
+            if (breakOrder >= 0) {
+                order = breakOrder;
+                row = breakRow;
+                breakOrder = -1;
+                breakRow = -1;
+            } else if (++row >= ROWS) {
+                row = 0;
+                order++;
+            }
+
+            if (order >= songLength) {
+                if (!repeat) {
+                    ended = true;
+                    return;
+                }
+                order = restartOrder < songLength ? restartOrder : 0;
+            }
+        }
+
+        void processTick() {
+            if (tick >= speed) {
+                tick = 0;
+                nextRow();
+                if (ended) return;
+            }
+
+            if (tick == 0) {
+                processRow();
+            } else {
+                processTickEffects();
+            }
+            tick++;
+            tickLeft = tickSamples;
+        }
+
+        void mixChannel(Channel& channel, int32_t* mix, size_t frames) {
+            const ModSample* sample = channel.sample;
+            if (!sample || !sample->data || channel.step == 0 || channel.volume == 0) return;
+
+            bool looped = sample->loopLength > 2;
+            uint32_t end = looped ? sample->loopStart + sample->loopLength : sample->length;
+            int32_t volume = channel.volume;
+
+            for (size_t i = 0; i < frames; i++) {
+                if (channel.position >= end) {
+                    if (!looped) {
+                        channel.sample = nullptr;
+                        return;
+                    }
+                    channel.position = sample->loopStart + (channel.position - end) % sample->loopLength;
+                }
+
+                uint32_t next = channel.position + 1;
+                if (next >= end) next = looped ? sample->loopStart : channel.position;
+                int32_t a = sample->data[channel.position] << 8;
+                int32_t b = sample->data[next] << 8;
+                int32_t value = a + (((b - a) * (int32_t)(channel.fraction >> 1)) >> 15);
+                mix[i] += (value * volume) >> 6;
+
+                channel.fraction += channel.step;
+                channel.position += channel.fraction >> 16;
+                channel.fraction &= 0xFFFF;
+            }
+        }
+
+    public:
+        ModPlayer(uint32_t sampleRate = 32000)
+            : patterns(nullptr), orders(nullptr), sampleRate(sampleRate),
+            clockStep((uint32_t)(3546895ULL * 65536 / sampleRate)), channelCount(0), songLength(0),
+            restartOrder(0), masterGain((1 << 15) / 2), repeat(false), ended(true) {}
+
+        // Parses the module in place; data must stay valid while playing
+        bool open(const uint8_t* data, size_t size) {
+            channelCount = 0;
+            ended = true;
+            if (!data || size < 1084) return false;
+
+            const uint8_t* tag = data + 1080;
+            if (memcmp(tag, "M.K.", 4) == 0 || memcmp(tag, "M!K!", 4) == 0
+                || memcmp(tag, "FLT4", 4) == 0 || memcmp(tag, "4CHN", 4) == 0) {
+                channelCount = 4;
+            } else if (tag[0] >= '1' && tag[0] <= '8' && memcmp(tag + 1, "CHN", 3) == 0) {
+                channelCount = tag[0] - '0';
+            } else {
+                return false;
+            }
+
+            songLength = min((int)data[950], 128);
+            restartOrder = data[951];
+            orders = data + 952;
+
+            int patternCount = 0;
+            for (int i = 0; i < 128; i++) patternCount = max(patternCount, orders[i] + 1);
+
+            patterns = data + 1084;
+            size_t offset = 1084 + (size_t)patternCount * ROWS * channelCount * 4;
+            if (offset > size || songLength == 0) {
+                channelCount = 0;
+                return false;
+            }
+
+            for (int i = 0; i < SAMPLE_COUNT; i++) {
+                const uint8_t* header = data + 20 + i * 30;
+                ModSample& sample = samples[i];
+                uint32_t length = (uint32_t)readBE16(header + 22) * 2;
+                sample.finetune = (int8_t)((header[24] & 0x0F) << 4) >> 4;
+                sample.volume = min((int)header[25], 64);
+                sample.loopStart = (uint32_t)readBE16(header + 26) * 2;
+                sample.loopLength = (uint32_t)readBE16(header + 28) * 2;
+
+                // Truncated modules keep whatever sample data is present
+                length = offset < size ? min((size_t)length, size - offset) : 0;
+                sample.data = length ? reinterpret_cast<const int8_t*>(data + offset) : nullptr;
+                sample.length = length;
+                if (sample.loopStart >= length) sample.loopLength = 0;
+                if (sample.loopStart + sample.loopLength > length) sample.loopLength = length - sample.loopStart;
+                offset += length;
+            }
+
+            rewind();
+            return true;
+        }
+
+        void setLevel(float level) {
+            masterGain = (int32_t)(constrain(level, 0.0f, 1.0f) * (1 << 15));
+        }
+
+        size_t read(int16_t* out, size_t frames) override {
+            int32_t mix[64];
+            size_t done = 0;
+
+            while (done < frames && !ended) {
+                if (tickLeft == 0) {
+                    processTick();
+                    if (ended) break;
+                }
+
+                size_t chunk = min(min(frames - done, (size_t)tickLeft), sizeof(mix) / sizeof(mix[0]));
+                memset(mix, 0, chunk * sizeof(int32_t));
+                for (int c = 0; c < channelCount; c++) mixChannel(channels[c], mix, chunk);
+
+                for (size_t i = 0; i < chunk; i++) {
+                    int32_t sample = (int32_t)(((int64_t)mix[i] * masterGain) >> 15);
+                    out[done + i] = sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : (int16_t)sample;
+                }
+
+                done += chunk;
+                tickLeft -= chunk;
+            }
+            return done;
+        }
+
+        bool rewind() override {
+            if (channelCount == 0) return false;
+            memset(channels, 0, sizeof(channels));
+            order = 0;
+            row = 0;
+            tick = 0;
+            speed = 6;
+            tempo = 125;
+            breakOrder = -1;
+            breakRow = -1;
+            tickLeft = 0;
+            ended = false;
+            setTiming();
+            return true;
+        }
+
+        bool setLooping(bool enable) override {
+            repeat = enable;
+            return true;
+        }
+    };
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/Stream.h>
+#include <async/AudioSource.h>
+
+// Fixed-point Helix MP3 decoder, e.g. lib_deps = pschatzmann/arduino-libhelix
+#if defined(__has_include)
+#if __has_include(<libhelix-mp3/mp3dec.h>)
+#include <libhelix-mp3/mp3dec.h>
+#define ASYNC_AUDIO_MP3 1
+#elif __has_include(<mp3dec.h>)
+#include <mp3dec.h>
+#define ASYNC_AUDIO_MP3 1
+#endif
+#endif
+
+#ifdef ASYNC_AUDIO_MP3
+// Open MP3 sources at any one time, each holding one set of codec buffers
+#ifndef ASYNC_AUDIO_MP3_DECODERS
+#define ASYNC_AUDIO_MP3_DECODERS 2
+#endif
+
+namespace async {
+    // Helix decoder state plus the input, frame and FIFO buffers of one open
+    // Mp3Source, about 38 KB together. Sets are allocated on first use and
+    // then reused, so memory stays at ASYNC_AUDIO_MP3_DECODERS sets however
+    // many files are played, queued or cached.
+    struct Mp3Buffers {
+        HMP3Decoder decoder;
+        uint8_t* input;
+        int16_t* pcm;
+        int16_t* fifo;
+        bool used;
+    };
+
+    // MP3 from a Stream (SD card file, flash, ...) as a track source. Frames
+    // are decoded into a PCM FIFO from prefetch(), which the player calls
+    // after each block has gone to the output, so a frame's decode cost is
+    // spread ahead of the mixer. read() only decodes itself when the FIFO
+    // runs dry (counted as an underrun). Output is mono at the file's rate;
+    // there is no resampler, so a player can require its own rate.
+    class Mp3Source : public AudioSource {
+    public:
+        static const size_t FIFO_SIZE = 4096;
+        static const size_t FRAME_SAMPLES = 1152;
+
+    private:
+        Stream* stream;
+        Mp3Buffers* buffers;
+        HMP3Decoder decoder;
+        uint8_t* input;
+        int16_t* pcm;
+        int16_t* fifo;
+        uint8_t* readPtr;
+        int bytesLeft;
+        size_t fifoRead;
+        size_t fifoCount;
+        size_t dataStart;
+        uint32_t sampleRate;
+        uint32_t requiredRate;
+        bool endOfStream;
+        bool finished;
+        DecodeStats stats;
+
+        static Mp3Buffers* pool() {
+            static Mp3Buffers sets[ASYNC_AUDIO_MP3_DECODERS];
+            return sets;
+        }
+
+        // A free set, allocating it if it never was; nullptr when all are open
+        static Mp3Buffers* acquireBuffers() {
+            Mp3Buffers* sets = pool();
+            for (int i = 0; i < ASYNC_AUDIO_MP3_DECODERS; i++) {
+                Mp3Buffers& set = sets[i];
+                if (set.used) continue;
+                if (!set.decoder) set.decoder = MP3InitDecoder();
+                if (!set.input) set.input = (uint8_t*)malloc(MAINBUF_SIZE * 2);
+                if (!set.pcm) set.pcm = (int16_t*)malloc(FRAME_SAMPLES * 2 * sizeof(int16_t));
+                if (!set.fifo) set.fifo = (int16_t*)malloc(FIFO_SIZE * sizeof(int16_t));
+                if (!set.decoder || !set.input || !set.pcm || !set.fifo) return nullptr;
+                set.used = true;
+                return &set;
+            }
+            return nullptr;
+        }
+
+        static uint32_t cycles() {
+#ifdef ESP32
+            return ESP.getCycleCount();
+#else
+            return 0;
+#endif
+        }
+
+        // Tops the input buffer up behind the unread bytes
+        void fill() {
+            if (endOfStream) return;
+            if (bytesLeft > 0 && readPtr != input) memmove(input, readPtr, bytesLeft);
+            readPtr = input;
+            size_t got = stream->read(reinterpret_cast<char*>(input + bytesLeft), MAINBUF_SIZE * 2 - bytesLeft);
+            if (got == 0) endOfStream = true;
+            bytesLeft += got;
+        }
+
+        // Size of a leading ID3v2 tag, so sync search doesn't start inside it
+        size_t skipId3() {
+            uint8_t header[10];
+            stream->seek(0);
+            if (stream->read(reinterpret_cast<char*>(header), sizeof(header)) != sizeof(header)) return 0;
+            if (memcmp(header, "ID3", 3) != 0) return 0;
+            // Syncsafe size, plus the footer if present
+            size_t size = ((header[6] & 0x7F) << 21) | ((header[7] & 0x7F) << 14) | ((header[8] & 0x7F) << 7) | (header[9] & 0x7F);
+            return 10 + size + (header[5] & 0x10 ? 10 : 0);
+        }
+
+        // Decodes the next good frame into the FIFO. Damaged or foreign data
+        // is skipped a byte at a time until the next frame sync.
+        bool decodeFrame() {
+            while (true) {
+                if (bytesLeft < MAINBUF_SIZE) fill();
+                if (bytesLeft <= 0) return false;
+
+                int offset = MP3FindSyncWord(readPtr, bytesLeft);
+                if (offset < 0) {
+                    // Keep the last bytes: a sync word may straddle the refill
+                    int keep = min(bytesLeft, 1);
+                    readPtr += bytesLeft - keep;
+                    bytesLeft = keep;
+                    if (endOfStream) return false;
+                    fill();
+                    continue;
+                }
+                if (offset > 0) stats.syncErrors++;
+                readPtr += offset;
+                bytesLeft -= offset;
+
+                uint32_t start = cycles();
+                int error = MP3Decode(decoder, &readPtr, &bytesLeft, pcm, 0);
+                uint32_t spent = cycles() - start;
+
+                if (error == ERR_MP3_NONE) {
+                    MP3FrameInfo info;
+                    MP3GetLastFrameInfo(decoder, &info);
+                    // Would play at the wrong pitch
+                    if (requiredRate && (uint32_t)info.samprate != requiredRate) return false;
+                    sampleRate = info.samprate;
+                    push(info);
+
+                    stats.frames++;
+                    stats.lastCycles = spent;
+                    stats.maxCycles = max(stats.maxCycles, spent);
+                    stats.totalCycles += spent;
+                    return true;
+                }
+
+                if (error == ERR_MP3_INDATA_UNDERFLOW) {
+                    if (endOfStream) return false;
+                    fill();
+                } else if (error != ERR_MP3_MAINDATA_UNDERFLOW) {
+                    // Not a real frame header: step past it and search again
+                    stats.syncErrors++;
+                    if (bytesLeft > 0) {
+                        readPtr++;
+                        bytesLeft--;
+                    }
+                }
+                // Main data underflow consumed the frame (bit reservoir not filled yet)
+            }
+        }
+
+        // Mixes the frame down to mono into the FIFO
+        void push(const MP3FrameInfo& info) {
+            int channels = max(info.nChans, 1);
+            size_t frames = min((size_t)(info.outputSamps / channels), (size_t)FRAME_SAMPLES);
+            size_t write = (fifoRead + fifoCount) % FIFO_SIZE;
+
+            for (size_t i = 0; i < frames; i++) {
+                int32_t sample = pcm[i * channels];
+                if (channels == 2) sample = (sample + pcm[i * 2 + 1]) >> 1;
+                fifo[write] = (int16_t)sample;
+                write = (write + 1) % FIFO_SIZE;
+            }
+            fifoCount += frames;
+        }
+
+    public:
+        Mp3Source() : stream(nullptr), buffers(nullptr), decoder(nullptr), input(nullptr), pcm(nullptr), fifo(nullptr),
+            readPtr(nullptr), bytesLeft(0), fifoRead(0), fifoCount(0), dataStart(0), sampleRate(0),
+            requiredRate(0), endOfStream(true), finished(true) {
+            memset(&stats, 0, sizeof(stats));
+        }
+
+        ~Mp3Source() {
+            close();
+        }
+
+        // Takes a set of codec buffers from the pool and decodes the first
+        // frame to learn the rate. Fails while ASYNC_AUDIO_MP3_DECODERS other
+        // sources are open. With a requiredRate, files at any other rate are
+        // rejected.
+        bool open(Stream* source, uint32_t requiredRate = 0) {
+            close();
+            memset(&stats, 0, sizeof(stats));
+            if (!source) return false;
+
+            buffers = acquireBuffers();
+            if (!buffers) return false;
+            decoder = buffers->decoder;
+            input = buffers->input;
+            pcm = buffers->pcm;
+            fifo = buffers->fifo;
+
+            stream = source;
+            this->requiredRate = requiredRate;
+            dataStart = skipId3();
+            if (!rewind()) {
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        // Returns the codec buffers to the pool
+        void close() {
+            if (buffers) buffers->used = false;
+            buffers = nullptr;
+            decoder = nullptr;
+            input = nullptr;
+            pcm = nullptr;
+            fifo = nullptr;
+            stream = nullptr;
+            sampleRate = 0;
+            finished = true;
+        }
+
+        uint32_t getSampleRate() const {
+            return sampleRate;
+        }
+
+        size_t read(int16_t* samples, size_t frames) override {
+            if (!stream) return 0;
+
+            size_t done = 0;
+            while (done < frames) {
+                if (fifoCount == 0) {
+                    if (finished || !decodeFrame()) {
+                        finished = true;
+                        break;
+                    }
+                    stats.underruns++;
+                }
+                size_t chunk = min(min(frames - done, fifoCount), FIFO_SIZE - fifoRead);
+                memcpy(samples + done, fifo + fifoRead, chunk * sizeof(int16_t));
+                fifoRead = (fifoRead + chunk) % FIFO_SIZE;
+                fifoCount -= chunk;
+                done += chunk;
+            }
+            return done;
+        }
+
+        // One frame per call at most, while a whole frame still fits
+        void prefetch() override {
+            if (!stream || finished || FIFO_SIZE - fifoCount < FRAME_SAMPLES) return;
+            if (!decodeFrame()) finished = true;
+        }
+
+        bool getDecodeStats(DecodeStats& out) const override {
+            out = stats;
+            return true;
+        }
+
+        bool rewind() override {
+            if (!stream) return false;
+            stream->seek(dataStart);
+            readPtr = input;
+            bytesLeft = 0;
+            fifoRead = 0;
+            fifoCount = 0;
+            endOfStream = false;
+            finished = false;
+            if (!decodeFrame()) {
+                finished = true;
+                return false;
+            }
+            return true;
+        }
+    };
+}
+#endif
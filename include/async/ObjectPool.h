@@ -0,0 +1,121 @@
+#pragma once
+
+#include <Arduino.h>
+#include <new>
+#include <async/AudioSource.h>
+
+namespace async {
+    // N objects of T constructed in place in fixed storage. Acquiring and
+    // releasing never touches the heap, so per-play objects (streams over
+    // flash data, sources) can't leak or fragment it.
+    template <typename T, size_t N>
+    class ObjectPool {
+    private:
+        union Slot {
+            char bytes[sizeof(T)];
+            void* align;
+            uint64_t align64;
+        };
+
+        Slot slots[N];
+        bool used[N];
+
+        int indexOf(const T* object) const {
+            for (size_t i = 0; i < N; i++) {
+                if (used[i] && reinterpret_cast<const T*>(&slots[i]) == object) return (int)i;
+            }
+            return -1;
+        }
+
+    public:
+        ObjectPool() {
+            memset(used, 0, sizeof(used));
+        }
+
+        ObjectPool(const ObjectPool&) = delete;
+        ObjectPool& operator=(const ObjectPool&) = delete;
+
+        ~ObjectPool() {
+            for (size_t i = 0; i < N; i++) {
+                if (used[i]) reinterpret_cast<T*>(&slots[i])->~T();
+            }
+        }
+
+        // Constructs a T from args in a free slot, nullptr when all N are taken
+        template <typename... Args>
+        T* acquire(const Args&... args) {
+            for (size_t i = 0; i < N; i++) {
+                if (used[i]) continue;
+                used[i] = true;
+                return new (&slots[i]) T(args...);
+            }
+            return nullptr;
+        }
+
+        // Destroys the object and frees its slot; foreign pointers are ignored
+        bool release(T* object) {
+            int index = indexOf(object);
+            if (index < 0) return false;
+            object->~T();
+            used[index] = false;
+            return true;
+        }
+
+        bool owns(const T* object) const {
+            return indexOf(object) >= 0;
+        }
+
+        size_t available() const {
+            size_t count = 0;
+            for (size_t i = 0; i < N; i++) {
+                if (!used[i]) count++;
+            }
+            return count;
+        }
+
+        static size_t capacity() {
+            return N;
+        }
+    };
+
+    // Pool of AudioSources that return themselves once the player releases
+    // them (stop, replacement, end of a queued pass), so fire-and-forget
+    // play(track, pool.acquire(...)) needs no bookkeeping. Each source is
+    // for one track at a time; one that never got played goes back with
+    // its release().
+    template <typename T, size_t N>
+    class SourcePool {
+    private:
+        class Pooled : public T {
+        private:
+            SourcePool* owner;
+
+        public:
+            template <typename... Args>
+            Pooled(SourcePool* pool, const Args&... args) : T(args...), owner(pool) {}
+
+            void release() override {
+                T::release();
+                SourcePool* pool = owner;
+                owner = nullptr;
+                if (pool) pool->objects.release(this);
+            }
+        };
+
+        ObjectPool<Pooled, N> objects;
+
+    public:
+        template <typename... Args>
+        T* acquire(const Args&... args) {
+            return objects.acquire(this, args...);
+        }
+
+        size_t available() const {
+            return objects.available();
+        }
+
+        static size_t capacity() {
+            return N;
+        }
+    };
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+
+namespace async {
+    enum Waveform {
+        WAVE_SINE,
+        WAVE_SQUARE,
+        WAVE_SAW,
+        WAVE_TRIANGLE,
+        WAVE_NOISE
+    };
+
+    // Band-limited single-cycle tables, built on first use. Each waveform has
+    // one table per octave band so the harmonics stay below Nyquist.
+    class Wavetables {
+    public:
+        static const int TABLE_BITS = 8;
+        static const int TABLE_SIZE = 1 << TABLE_BITS;
+        static const int BANDS = 8;
+
+        // Band 0 carries TABLE_SIZE / 2 harmonics, each further band half as many
+        static const int16_t* get(Waveform waveform, int band) {
+            if (waveform == WAVE_SINE) return sine();
+
+            int16_t*& tables = storage(waveform);
+            if (!tables) tables = build(waveform);
+            if (!tables) return sine();
+            return tables + band * TABLE_SIZE;
+        }
+
+        // Picks the band for a phase increment (2^32 per cycle per sample)
+        static int bandFor(uint32_t increment) {
+            int band = 0;
+            uint32_t harmonics = TABLE_SIZE / 2;
+            while (band < BANDS - 1 && (uint64_t)harmonics * increment >= 0x80000000UL) {
+                harmonics >>= 1;
+                band++;
+            }
+            return band;
+        }
+
+        static const int16_t* sine() {
+            static int16_t table[TABLE_SIZE];
+            static bool ready = false;
+            if (!ready) {
+                for (int i = 0; i < TABLE_SIZE; i++) {
+                    table[i] = (int16_t)(sinf(2.0f * (float)M_PI * i / TABLE_SIZE) * 32767.0f);
+                }
+                ready = true;
+            }
+            return table;
+        }
+
+    private:
+        static int16_t*& storage(Waveform waveform) {
+            static int16_t* tables[WAVE_NOISE] = {};
+            return tables[waveform];
+        }
+
+        // Additive synthesis from the sine table; harmonic h of entry i is sine[(i * h) % size]
+        static int16_t* build(Waveform waveform) {
+            int16_t* tables = (int16_t*)malloc(BANDS * TABLE_SIZE * sizeof(int16_t));
+            if (!tables) return nullptr;
+
+            const int16_t* sin = sine();
+            int32_t sum[TABLE_SIZE];
+
+            for (int band = 0; band < BANDS; band++) {
+                int harmonics = (TABLE_SIZE / 2) >> band;
+                memset(sum, 0, sizeof(sum));
+
+                for (int h = 1; h <= harmonics; h++) {
+                    int32_t amplitude;
+                    if (waveform == WAVE_SAW) {
+                        amplitude = 32768 / h;
+                    } else if (h % 2 == 0) {
+                        continue;
+                    } else if (waveform == WAVE_SQUARE) {
+                        amplitude = 32768 / h;
+                    } else {
+                        amplitude = (h % 4 == 1 ? 32768 : -32768) / (h * h);
+                    }
+
+                    for (int i = 0; i < TABLE_SIZE; i++) {
+                        sum[i] += (sin[(i * h) & (TABLE_SIZE - 1)] * amplitude) >> 15;
+                    }
+                }
+
+                int32_t peak = 1;
+                for (int i = 0; i < TABLE_SIZE; i++) {
+                    peak = max(peak, (int32_t)abs(sum[i]));
+                }
+
+                int16_t* table = tables + band * TABLE_SIZE;
+                for (int i = 0; i < TABLE_SIZE; i++) {
+                    table[i] = (int16_t)(((int64_t)sum[i] * 32000) / peak);
+                }
+            }
+            return tables;
+        }
+    };
+
+    // Wavetable oscillator with a 32-bit phase accumulator. The top bits index
+    // the table and the next 15 interpolate between neighbouring entries.
+    class Oscillator {
+    private:
+        Waveform waveform;
+        const int16_t* table;
+        uint32_t phase;
+        uint32_t increment;
+        uint32_t noise;
+        int16_t noiseValue;
+
+        void selectTable() {
+            if (waveform != WAVE_NOISE) {
+                table = Wavetables::get(waveform, Wavetables::bandFor(increment));
+            }
+        }
+
+    public:
+        Oscillator() : waveform(WAVE_SINE), table(Wavetables::sine()), phase(0), increment(0),
+            noise(0x12345678), noiseValue(0) {}
+
+        static uint32_t incrementFor(float frequency, uint32_t sampleRate) {
+            if (frequency <= 0.0f || sampleRate == 0) return 0;
+            return (uint32_t)(frequency / sampleRate * 4294967296.0);
+        }
+
+        void setWaveform(Waveform value) {
+            waveform = value;
+            selectTable();
+        }
+
+        Waveform getWaveform() const {
+            return waveform;
+        }
+
+        void setFrequency(float frequency, uint32_t sampleRate) {
+            setIncrement(incrementFor(frequency, sampleRate));
+        }
+
+        void setIncrement(uint32_t value) {
+            if (Wavetables::bandFor(value) != Wavetables::bandFor(increment)) {
+                increment = value;
+                selectTable();
+            } else {
+                increment = value;
+            }
+        }
+
+        uint32_t getIncrement() const {
+            return increment;
+        }
+
+        void reset() {
+            phase = 0;
+        }
+
+        int16_t next() {
+            uint32_t current = phase;
+            phase += increment;
+
+            if (waveform == WAVE_NOISE) {
+                // Sample-and-hold noise, refreshed once per cycle so it follows pitch
+                if (phase < current || increment >= 0x80000000UL) {
+                    noise ^= noise << 13;
+                    noise ^= noise >> 17;
+                    noise ^= noise << 5;
+                    noiseValue = (int16_t)(noise >> 16);
+                }
+                return noiseValue;
+            }
+
+            uint32_t index = current >> (32 - Wavetables::TABLE_BITS);
+            int32_t frac = (current >> (17 - Wavetables::TABLE_BITS)) & 0x7FFF;
+            int32_t a = table[index];
+            int32_t b = table[(index + 1) & (Wavetables::TABLE_SIZE - 1)];
+            return (int16_t)(a + (((b - a) * frac) >> 15));
+        }
+    };
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/Stream.h>
+#include <async/AudioSource.h>
+
+namespace async {
+    // Streaming "Quite OK Audio" decoder (qoaformat.org). Reads one slice
+    // (8 bytes, 20 samples) per channel at a time from the Stream, so the
+    // only state is the LMS predictor per channel and one decoded slice.
+    // Integer only. Stereo files are mixed down to mono.
+    class QoaSource : public AudioSource {
+    public:
+        static const int MAX_CHANNELS = 2;
+        static const int SLICE_LEN = 20;
+        static const int SLICES_PER_FRAME = 256;
+        static const size_t FILE_HEADER_SIZE = 8;
+
+    private:
+        struct Lms {
+            int32_t history[4];
+            int32_t weights[4];
+        };
+
+        Stream* stream;
+        Lms lms[MAX_CHANNELS];
+        int16_t slice[SLICE_LEN];
+        uint32_t totalFrames;
+        uint32_t sampleRate;
+        uint8_t channels;
+        size_t position;
+        uint16_t frameFrames;
+        uint16_t frameDone;
+        uint8_t sliceLen;
+        uint8_t slicePos;
+
+        static int16_t readBE16(const uint8_t* p) {
+            return (int16_t)((p[0] << 8) | p[1]);
+        }
+
+        static uint32_t readBE32(const uint8_t* p) {
+            return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+        }
+
+        static uint64_t readBE64(const uint8_t* p) {
+            return ((uint64_t)readBE32(p) << 32) | readBE32(p + 4);
+        }
+
+        bool readExact(void* dst, size_t len) {
+            return stream->read(reinterpret_cast<char*>(dst), len) == len;
+        }
+
+        // round(scalefactor * {0.75, -0.75, 2.5, -2.5, 4.5, -4.5, 7, -7}[q]), halves away from zero
+        static int32_t dequantize(int scalefactor, int quantized) {
+            static const uint16_t scalefactors[16] = {
+                1, 7, 21, 45, 84, 138, 211, 304, 421, 562, 731, 928, 1157, 1419, 1715, 2048
+            };
+            int32_t sf = scalefactors[scalefactor];
+            int32_t magnitude;
+            switch (quantized >> 1) {
+                case 0: magnitude = (sf * 3 + 2) / 4; break;
+                case 1: magnitude = (sf * 5 + 1) / 2; break;
+                case 2: magnitude = (sf * 9 + 1) / 2; break;
+                default: magnitude = sf * 7; break;
+            }
+            return quantized & 1 ? -magnitude : magnitude;
+        }
+
+        // Frame header plus each channel's LMS history and weights
+        bool readFrameHeader() {
+            uint8_t header[8];
+            if (!readExact(header, sizeof(header))) return false;
+            uint8_t frameChannels = header[0];
+            uint32_t frameRate = ((uint32_t)header[1] << 16) | (header[2] << 8) | header[3];
+            frameFrames = (header[4] << 8) | header[5];
+
+            if (frameChannels == 0 || frameChannels > MAX_CHANNELS || frameFrames == 0) return false;
+            if (frameFrames > SLICES_PER_FRAME * SLICE_LEN) return false;
+            // Streams may not change layout midway
+            if (channels && (frameChannels != channels || frameRate != sampleRate)) return false;
+            channels = frameChannels;
+            sampleRate = frameRate;
+
+            for (int c = 0; c < channels; c++) {
+                uint8_t state[16];
+                if (!readExact(state, sizeof(state))) return false;
+                for (int i = 0; i < 4; i++) {
+                    lms[c].history[i] = readBE16(state + i * 2);
+                    lms[c].weights[i] = readBE16(state + 8 + i * 2);
+                }
+            }
+            frameDone = 0;
+            return true;
+        }
+
+        // Decodes the next slice of every channel into slice[], mixed down
+        bool decodeSlice() {
+            if (totalFrames && position >= totalFrames) return false;
+            if (frameDone >= frameFrames && !readFrameHeader()) return false;
+
+            uint8_t count = (uint8_t)min((int)SLICE_LEN, frameFrames - frameDone);
+            int32_t mix[SLICE_LEN];
+
+            for (int c = 0; c < channels; c++) {
+                uint8_t bytes[8];
+                if (!readExact(bytes, sizeof(bytes))) return false;
+                uint64_t bits = readBE64(bytes);
+                int scalefactor = (bits >> 60) & 0x0F;
+                bits <<= 4;
+                Lms& state = lms[c];
+
+                for (int i = 0; i < count; i++) {
+                    int32_t predicted = 0;
+                    for (int k = 0; k < 4; k++) predicted += state.weights[k] * state.history[k];
+                    predicted >>= 13;
+
+                    int32_t residual = dequantize(scalefactor, (int)((bits >> 61) & 0x07));
+                    int32_t sample = predicted + residual;
+                    sample = sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : sample;
+                    bits <<= 3;
+
+                    int32_t delta = residual >> 4;
+                    for (int k = 0; k < 4; k++) state.weights[k] += state.history[k] < 0 ? -delta : delta;
+                    state.history[0] = state.history[1];
+                    state.history[1] = state.history[2];
+                    state.history[2] = state.history[3];
+                    state.history[3] = sample;
+
+                    mix[i] = c == 0 ? sample : mix[i] + sample;
+                }
+            }
+
+            for (int i = 0; i < count; i++) slice[i] = (int16_t)(mix[i] / channels);
+            frameDone += count;
+            sliceLen = count;
+            slicePos = 0;
+            return true;
+        }
+
+    public:
+        QoaSource() : stream(nullptr), totalFrames(0), sampleRate(0), channels(0), position(0),
+            frameFrames(0), frameDone(0), sliceLen(0), slicePos(0) {}
+
+        // Checks the file header and the first frame's layout. With a
+        // requiredRate, files at any other rate are rejected.
+        bool open(Stream* source, uint32_t requiredRate = 0) {
+            stream = source;
+            channels = 0;
+            if (!stream) return false;
+
+            uint8_t header[FILE_HEADER_SIZE];
+            stream->seek(0);
+            if (!readExact(header, sizeof(header)) || memcmp(header, "qoaf", 4) != 0) {
+                stream = nullptr;
+                return false;
+            }
+            totalFrames = readBE32(header + 4);
+
+            if (!rewind() || (requiredRate && sampleRate != requiredRate)) {
+                stream = nullptr;
+                return false;
+            }
+            return true;
+        }
+
+        uint32_t getSampleRate() const {
+            return sampleRate;
+        }
+
+        uint8_t getChannels() const {
+            return channels;
+        }
+
+        size_t read(int16_t* samples, size_t frames) override {
+            if (!stream) return 0;
+
+            size_t done = 0;
+            while (done < frames) {
+                if (slicePos >= sliceLen && !decodeSlice()) break;
+                size_t chunk = min(frames - done, (size_t)(sliceLen - slicePos));
+                if (totalFrames) chunk = min(chunk, totalFrames - position);
+                if (chunk == 0) break;
+                memcpy(samples + done, slice + slicePos, chunk * sizeof(int16_t));
+                slicePos += chunk;
+                position += chunk;
+                done += chunk;
+            }
+            return done;
+        }
+
+        // Files written in streaming mode don't declare their length
+        size_t remaining() const override {
+            if (!stream) return 0;
+            return totalFrames ? totalFrames - position : UNKNOWN_LENGTH;
+        }
+
+        bool rewind() override {
+            if (!stream) return false;
+            stream->seek(FILE_HEADER_SIZE);
+            position = 0;
+            sliceLen = 0;
+            slicePos = 0;
+            if (!readFrameHeader()) return false;
+            return true;
+        }
+    };
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <async/Notes.h>
+#include <async/Buzzer.h>
+
+namespace async {
+    // Parser for RTTTL ringtones ("name:d=4,o=5,b=120:8e6,8p,g.6,...").
+    // The text stays in flash; only the compiled BuzzerNote list takes RAM,
+    // four bytes per note, and it plays on a Buzzer or through a MelodySource.
+    class Rtttl {
+    private:
+        static uint32_t octave7(int semitone) {
+            static const uint16_t frequencies[12] = {
+                NOTE_C7, NOTE_CS7, NOTE_D7, NOTE_DS7, NOTE_E7, NOTE_F7,
+                NOTE_FS7, NOTE_G7, NOTE_GS7, NOTE_A7, NOTE_AS7, NOTE_B7
+            };
+            return frequencies[semitone];
+        }
+
+        static void skipSpaces(const char*& p) {
+            while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        }
+
+        static int readNumber(const char*& p) {
+            int value = 0;
+            while (*p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+            return value;
+        }
+
+        static int semitoneOf(char c) {
+            switch (c | 0x20) {
+                case 'c': return 0;
+                case 'd': return 2;
+                case 'e': return 4;
+                case 'f': return 5;
+                case 'g': return 7;
+                case 'a': return 9;
+                case 'b': return 11;
+                default: return -1;
+            }
+        }
+
+    public:
+        static uint16_t frequencyOf(int semitone, int octave) {
+            if (octave < 1 || octave > 8) return 0;
+            uint32_t frequency = octave7(semitone % 12);
+            return octave >= 7 ? frequency << (octave - 7) : (frequency + (1 << (6 - octave))) >> (7 - octave);
+        }
+
+        // Returns the number of notes written, 0 on a malformed header
+        static size_t parse(const char* text, BuzzerNote* notes, size_t capacity) {
+            if (!text || !notes) return 0;
+
+            const char* p = text;
+            while (*p && *p != ':') p++;
+            if (*p++ != ':') return 0;
+
+            int defaultDuration = 4;
+            int defaultOctave = 6;
+            int bpm = 63;
+
+            while (*p && *p != ':') {
+                skipSpaces(p);
+                char key = *p | 0x20;
+                if (*p) p++;
+                skipSpaces(p);
+                if (*p == '=') p++;
+                skipSpaces(p);
+                int value = readNumber(p);
+                if (key == 'd' && value > 0) defaultDuration = value;
+                else if (key == 'o' && value > 0) defaultOctave = value;
+                else if (key == 'b' && value > 0) bpm = value;
+                skipSpaces(p);
+                if (*p == ',') p++;
+            }
+            if (*p++ != ':') return 0;
+
+            const uint32_t wholeNote = 240000UL / bpm;
+            size_t count = 0;
+
+            while (*p && count < capacity) {
+                skipSpaces(p);
+                int duration = readNumber(p);
+                if (duration <= 0) duration = defaultDuration;
+
+                int semitone = semitoneOf(*p);
+                bool rest = (*p | 0x20) == 'p';
+                if (semitone < 0 && !rest) break;
+                p++;
+
+                if (*p == '#' || *p == '_') {
+                    semitone++;
+                    p++;
+                }
+
+                bool dotted = false;
+                if (*p == '.') {
+                    dotted = true;
+                    p++;
+                }
+
+                int octave = readNumber(p);
+                if (octave == 0) octave = defaultOctave;
+
+                if (*p == '.') {
+                    dotted = true;
+                    p++;
+                }
+
+                uint32_t ms = wholeNote / duration;
+                if (dotted) ms += ms / 2;
+
+                // b# rolls into the next octave
+                if (semitone == 12) {
+                    semitone = 0;
+                    octave++;
+                }
+
+                notes[count].frequency = rest ? 0 : frequencyOf(semitone, octave);
+                notes[count].duration = ms > 0xFFFF ? 0xFFFF : (uint16_t)ms;
+                count++;
+
+                skipSpaces(p);
+                if (*p == ',') p++;
+            }
+            return count;
+        }
+    };
+
+    // Fixed-capacity compiled ringtone, e.g. static Melody<32> alert(ALERT_RTTTL);
+    template <size_t N>
+    class Melody {
+    private:
+        BuzzerNote events[N];
+        size_t length;
+
+    public:
+        Melody(const char* rtttl) : length(Rtttl::parse(rtttl, events, N)) {}
+
+        const BuzzerNote* notes() const { return events; }
+        size_t size() const { return length; }
+
+        void play(Buzzer& buzzer, bool loop = false) const {
+            buzzer.play(events, length, loop);
+        }
+    };
+}
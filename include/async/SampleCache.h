@@ -0,0 +1,293 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/Stream.h>
+#include <async/AudioSource.h>
+#include <async/WavAsset.h>
+#include <async/Decoders.h>
+
+namespace async {
+    // Decoded PCM of compressed sounds, keyed by an application chosen id.
+    // The first acquire() decodes the whole sound (into PSRAM when the board
+    // has it); later ones hand out the same samples. Sounds are refcounted
+    // and only unreferenced ones are evicted, least recently used first,
+    // when a new sound would not fit the byte budget.
+    class SampleCache {
+    public:
+        static const int MAX_ENTRIES = 16;
+        static const size_t DECODE_CHUNK = 1024;
+
+    private:
+        struct Entry {
+            uint32_t id;
+            int16_t* samples;
+            size_t frames;
+            size_t bytes;
+            uint32_t sampleRate;    // 0 if the caller didn't say
+            uint16_t refs;
+            uint32_t lastUse;
+            bool used;
+        };
+
+        Entry entries[MAX_ENTRIES];
+        size_t budget;
+        size_t usedBytes;
+        uint32_t clock;
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t evictions;
+
+        static void* allocate(size_t bytes) {
+#ifdef ESP32
+            if (psramFound()) {
+                void* memory = ps_malloc(bytes);
+                if (memory) return memory;
+            }
+#endif
+            return malloc(bytes);
+        }
+
+        Entry* lookup(uint32_t id) {
+            for (int i = 0; i < MAX_ENTRIES; i++) {
+                if (entries[i].used && entries[i].id == id) return &entries[i];
+            }
+            return nullptr;
+        }
+
+        void drop(Entry& entry) {
+            free(entry.samples);
+            usedBytes -= entry.bytes;
+            entry.samples = nullptr;
+            entry.frames = 0;
+            entry.bytes = 0;
+            entry.used = false;
+        }
+
+        // Evicts the least recently used unreferenced sound
+        bool evictOne() {
+            Entry* victim = nullptr;
+            for (int i = 0; i < MAX_ENTRIES; i++) {
+                Entry& entry = entries[i];
+                if (!entry.used || entry.refs > 0) continue;
+                if (!victim || (int32_t)(entry.lastUse - victim->lastUse) < 0) victim = &entry;
+            }
+            if (!victim) return false;
+            drop(*victim);
+            evictions++;
+            return true;
+        }
+
+        bool makeRoom(size_t bytes) {
+            if (bytes > budget) return false;
+            while (usedBytes + bytes > budget) {
+                if (!evictOne()) return false;
+            }
+            return true;
+        }
+
+        // A sound cached at one rate is never handed out for another
+        static bool rateMatches(const Entry& entry, uint32_t sampleRate) {
+            return !sampleRate || !entry.sampleRate || entry.sampleRate == sampleRate;
+        }
+
+        Entry* freeEntry() {
+            for (int i = 0; i < MAX_ENTRIES; i++) {
+                if (!entries[i].used) return &entries[i];
+            }
+            return evictOne() ? freeEntry() : nullptr;
+        }
+
+        // Whole sound into one buffer. Sources of unknown length grow it a
+        // chunk at a time, still within the budget; if they outgrow it the
+        // sound is not cached.
+        bool decode(AudioSource* source, int16_t*& samples, size_t& frames, size_t& bytes) {
+            size_t known = source->remaining();
+            size_t capacity = known != AudioSource::UNKNOWN_LENGTH ? known : DECODE_CHUNK;
+            if (capacity == 0 || !makeRoom(capacity * sizeof(int16_t))) return false;
+            samples = (int16_t*)allocate(capacity * sizeof(int16_t));
+            if (!samples) return false;
+            usedBytes += capacity * sizeof(int16_t);
+            frames = 0;
+
+            bool complete = false;
+            while (!complete) {
+                if (frames == capacity) {
+                    if (known != AudioSource::UNKNOWN_LENGTH) break;
+                    size_t grown = capacity * 2;
+                    int16_t* larger = makeRoom((grown - capacity) * sizeof(int16_t))
+                        ? (int16_t*)allocate(grown * sizeof(int16_t)) : nullptr;
+                    if (!larger) break;
+                    memcpy(larger, samples, frames * sizeof(int16_t));
+                    free(samples);
+                    samples = larger;
+                    usedBytes += (grown - capacity) * sizeof(int16_t);
+                    capacity = grown;
+                }
+                size_t got = source->read(samples + frames, min(capacity - frames, (size_t)DECODE_CHUNK));
+                frames += got;
+                complete = got == 0;
+            }
+
+            if (known != AudioSource::UNKNOWN_LENGTH) complete = true;
+            if (!complete || frames == 0) {
+                free(samples);
+                usedBytes -= capacity * sizeof(int16_t);
+                return false;
+            }
+            bytes = capacity * sizeof(int16_t);
+            return true;
+        }
+
+    public:
+        SampleCache(size_t budgetBytes) : budget(budgetBytes), usedBytes(0), clock(0),
+            hits(0), misses(0), evictions(0) {
+            memset(entries, 0, sizeof(entries));
+        }
+
+        SampleCache(const SampleCache&) = delete;
+        SampleCache& operator=(const SampleCache&) = delete;
+
+        ~SampleCache() {
+            for (int i = 0; i < MAX_ENTRIES; i++) {
+                if (entries[i].used) drop(entries[i]);
+            }
+        }
+
+        // Samples of a cached sound, with a reference held until release(id).
+        // nullptr if it isn't cached, or was cached at a rate other than a
+        // nonzero sampleRate.
+        const int16_t* acquire(uint32_t id, size_t& frames, uint32_t sampleRate = 0) {
+            Entry* entry = lookup(id);
+            if (!entry || !rateMatches(*entry, sampleRate)) return nullptr;
+            entry->refs++;
+            entry->lastUse = ++clock;
+            frames = entry->frames;
+            hits++;
+            return entry->samples;
+        }
+
+        // As above, decoding source to the end on a miss. A source has no
+        // rate to check, so the caller vouches for it; sampleRate is only
+        // recorded for later lookups.
+        const int16_t* acquire(uint32_t id, AudioSource* source, size_t& frames, uint32_t sampleRate = 0) {
+            if (contains(id)) return acquire(id, frames, sampleRate);
+            if (!source) return nullptr;
+            misses++;
+
+            Entry* entry = freeEntry();
+            if (!entry) return nullptr;
+            int16_t* samples = nullptr;
+            size_t decoded = 0;
+            size_t bytes = 0;
+            if (!decode(source, samples, decoded, bytes)) return nullptr;
+
+            entry->id = id;
+            entry->samples = samples;
+            entry->frames = decoded;
+            entry->bytes = bytes;
+            entry->sampleRate = sampleRate;
+            entry->refs = 1;
+            entry->lastUse = ++clock;
+            entry->used = true;
+            frames = decoded;
+            return samples;
+        }
+
+        // Any stream the decoder registry recognises. With a sampleRate
+        // (normally the player's), files at another rate are not cached.
+        const int16_t* acquire(uint32_t id, Stream* stream, size_t& frames, uint32_t sampleRate = 0) {
+            if (contains(id)) return acquire(id, frames, sampleRate);
+            if (!stream) return nullptr;
+            DecoderSlot decoder;
+            AudioSource* source = decoder.open(stream, sampleRate);
+            if (!source) return nullptr;
+            return acquire(id, source, frames, sampleRate);
+        }
+
+        void release(uint32_t id) {
+            Entry* entry = lookup(id);
+            if (entry && entry->refs > 0) entry->refs--;
+        }
+
+        bool contains(uint32_t id) const {
+            for (int i = 0; i < MAX_ENTRIES; i++) {
+                if (entries[i].used && entries[i].id == id) return true;
+            }
+            return false;
+        }
+
+        // Frees every unreferenced sound
+        void trim() {
+            while (evictOne()) {}
+        }
+
+        size_t getBudget() const {
+            return budget;
+        }
+
+        size_t getUsed() const {
+            return usedBytes;
+        }
+
+        uint32_t getHits() const {
+            return hits;
+        }
+
+        uint32_t getMisses() const {
+            return misses;
+        }
+
+        uint32_t getEvictions() const {
+            return evictions;
+        }
+    };
+
+    // Plays a cached sound in place and holds its reference until the player
+    // releases the source (stop, replacement or the end of a queued pass).
+    class CachedSource : public PcmSource {
+    private:
+        SampleCache* cache;
+        uint32_t id;
+
+    public:
+        CachedSource() : cache(nullptr), id(0) {}
+
+        CachedSource(const CachedSource&) = delete;
+        CachedSource& operator=(const CachedSource&) = delete;
+
+        ~CachedSource() {
+            release();
+        }
+
+        // Decodes the stream into the cache on first use. Pass the player's
+        // getSampleRate() to refuse sounds at another rate.
+        bool open(SampleCache& samples, uint32_t soundId, Stream* stream, uint32_t sampleRate = 0) {
+            release();
+            size_t frames = 0;
+            const int16_t* data = samples.acquire(soundId, stream, frames, sampleRate);
+            if (!data) return false;
+            cache = &samples;
+            id = soundId;
+            PcmSource::open(reinterpret_cast<const uint8_t*>(data), frames);
+            return true;
+        }
+
+        bool open(SampleCache& samples, uint32_t soundId, AudioSource* decoder, uint32_t sampleRate = 0) {
+            release();
+            size_t frames = 0;
+            const int16_t* data = samples.acquire(soundId, decoder, frames, sampleRate);
+            if (!data) return false;
+            cache = &samples;
+            id = soundId;
+            PcmSource::open(reinterpret_cast<const uint8_t*>(data), frames);
+            return true;
+        }
+
+        void release() override {
+            if (!cache) return;
+            cache->release(id);
+            cache = nullptr;
+            PcmSource::open(nullptr, 0);
+        }
+    };
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+#include <async/MidiInstrument.h>
+
+namespace async {
+    // One sample mapped to a note range of a program. loopEnd 0 means one-shot.
+    // The drum channel (10) uses program DRUM_PROGRAM.
+    struct SamplerZone {
+        const int16_t* samples;
+        uint32_t length;
+        uint32_t loopStart;
+        uint32_t loopEnd;
+        uint32_t sampleRate;
+        uint8_t program;
+        uint8_t rootNote;
+        uint8_t lowNote;
+        uint8_t highNote;
+    };
+
+    // Small sampled-instrument bank. Voices read the zone data in place with a
+    // Q16.16 position and linear interpolation; note-off fades out linearly.
+    template <int VOICES = 8>
+    class Sampler : public MidiInstrument {
+    public:
+        static const uint8_t DRUM_PROGRAM = 128;
+
+    private:
+        struct Voice {
+            const SamplerZone* zone;
+            uint32_t position;
+            uint32_t fraction;
+            uint32_t step;
+            int32_t gain;
+            int32_t releaseStep;
+            uint32_t age;
+            uint8_t channel;
+            uint8_t note;
+            bool releasing;
+        };
+
+        // Stolen voices fade out here over STEAL_FADE_MS instead of being cut
+        static const int STOLEN_VOICES = 2;
+        static const int STEAL_FADE_MS = 5;
+
+        Voice voices[VOICES + STOLEN_VOICES];
+        const SamplerZone* zones;
+        size_t zoneCount;
+        const uint32_t sampleRate;
+        uint8_t programs[16];
+        int32_t releaseStep;
+        int32_t stealStep;
+        int32_t masterGain;
+        uint32_t noteCounter;
+
+        const SamplerZone* findZone(uint8_t channel, uint8_t note) const {
+            uint8_t program = channel == 9 ? DRUM_PROGRAM : programs[channel & 0x0F];
+            for (size_t i = 0; i < zoneCount; i++) {
+                const SamplerZone& zone = zones[i];
+                if (zone.program == program && note >= zone.lowNote && note <= zone.highNote) return &zone;
+            }
+            return nullptr;
+        }
+
+        Voice& allocate() {
+            Voice* best = &voices[0];
+            for (int i = 0; i < VOICES; i++) {
+                if (!voices[i].zone) return voices[i];
+                if (voices[i].releasing != best->releasing ? voices[i].releasing : voices[i].age < best->age) {
+                    best = &voices[i];
+                }
+            }
+            if (best->zone) fadeOut(*best);
+            return *best;
+        }
+
+        // Hands a voice about to be reused to a stolen slot, releasing fast.
+        // With both busy the quieter one is cut.
+        void fadeOut(const Voice& voice) {
+            Voice* slot = &voices[VOICES];
+            for (int i = VOICES; i < VOICES + STOLEN_VOICES; i++) {
+                if (!voices[i].zone) {
+                    slot = &voices[i];
+                    break;
+                }
+                if (voices[i].gain < slot->gain) slot = &voices[i];
+            }
+            *slot = voice;
+            slot->releasing = true;
+            slot->releaseStep = max((voice.gain * stealStep) >> 15, (int32_t)1);
+        }
+
+        int32_t rampStep(float ms) const {
+            float frames = ms * sampleRate / 1000.0f;
+            return frames < 1.0f ? (1 << 15) : max((int32_t)((1 << 15) / frames), (int32_t)1);
+        }
+
+    public:
+        Sampler(const SamplerZone* zones, size_t zoneCount, uint32_t sampleRate = 32000)
+            : zones(zones), zoneCount(zoneCount), sampleRate(sampleRate),
+            masterGain((1 << 15) / 2), noteCounter(0) {
+            memset(voices, 0, sizeof(voices));
+            memset(programs, 0, sizeof(programs));
+            stealStep = rampStep(STEAL_FADE_MS);
+            setRelease(60.0f);
+        }
+
+        void setRelease(float ms) {
+            releaseStep = rampStep(ms);
+        }
+
+        void setLevel(float level) {
+            masterGain = (int32_t)(constrain(level, 0.0f, 1.0f) * (1 << 15));
+        }
+
+        void programChange(uint8_t channel, uint8_t program) override {
+            programs[channel & 0x0F] = program;
+        }
+
+        void noteOn(uint8_t channel, uint8_t note, uint8_t velocity) override {
+            if (velocity == 0) {
+                noteOff(channel, note);
+                return;
+            }
+            const SamplerZone* zone = findZone(channel, note);
+            if (!zone || zone->length == 0) return;
+
+            Voice& voice = allocate();
+            float ratio = powf(2.0f, ((int)note - zone->rootNote) / 12.0f) * zone->sampleRate / sampleRate;
+            voice.zone = zone;
+            voice.position = 0;
+            voice.fraction = 0;
+            voice.step = (uint32_t)(ratio * 65536.0f);
+            voice.gain = (((int32_t)velocity << 15) / 127 * masterGain) >> 15;
+            voice.releaseStep = 0;
+            voice.age = ++noteCounter;
+            voice.channel = channel;
+            voice.note = note;
+            voice.releasing = false;
+        }
+
+        void noteOff(uint8_t channel, uint8_t note) override {
+            for (int i = 0; i < VOICES; i++) {
+                Voice& voice = voices[i];
+                // Drum hits play out
+                if (voice.zone && !voice.releasing && voice.channel == channel && voice.note == note && channel != 9) {
+                    voice.releasing = true;
+                    voice.releaseStep = max((voice.gain * releaseStep) >> 15, (int32_t)1);
+                }
+            }
+        }
+
+        void allNotesOff() override {
+            for (int i = 0; i < VOICES; i++) {
+                Voice& voice = voices[i];
+                if (voice.zone && !voice.releasing) {
+                    voice.releasing = true;
+                    voice.releaseStep = max((voice.gain * releaseStep) >> 15, (int32_t)1);
+                }
+            }
+        }
+
+        size_t read(int16_t* samples, size_t frames) override {
+            int32_t mix[64];
+            size_t done = 0;
+
+            while (done < frames) {
+                size_t chunk = min(frames - done, sizeof(mix) / sizeof(mix[0]));
+                memset(mix, 0, chunk * sizeof(int32_t));
+
+                for (int v = 0; v < VOICES + STOLEN_VOICES; v++) {
+                    Voice& voice = voices[v];
+                    if (!voice.zone) continue;
+
+                    const SamplerZone& zone = *voice.zone;
+                    // Loop points past the data or out of order make the zone one-shot
+                    uint32_t loopEnd = min(zone.loopEnd, zone.length);
+                    bool looped = loopEnd > zone.loopStart;
+                    uint32_t end = looped ? loopEnd : zone.length;
+
+                    for (size_t i = 0; i < chunk; i++) {
+                        if (voice.position >= end) {
+                            if (!looped) {
+                                voice.zone = nullptr;
+                                break;
+                            }
+                            voice.position = zone.loopStart + (voice.position - end) % (end - zone.loopStart);
+                        }
+
+                        uint32_t next = voice.position + 1;
+                        if (next >= end) next = looped ? zone.loopStart : voice.position;
+                        int32_t a = zone.samples[voice.position];
+                        int32_t b = zone.samples[next];
+                        int32_t sample = a + (((b - a) * (int32_t)(voice.fraction >> 1)) >> 15);
+                        mix[i] += (sample * voice.gain) >> 15;
+
+                        voice.fraction += voice.step;
+                        voice.position += voice.fraction >> 16;
+                        voice.fraction &= 0xFFFF;
+
+                        if (voice.releasing) {
+                            voice.gain -= voice.releaseStep;
+                            if (voice.gain <= 0) {
+                                voice.zone = nullptr;
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < chunk; i++) {
+                    int32_t sample = mix[i];
+                    samples[done + i] = sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : (int16_t)sample;
+                }
+                done += chunk;
+            }
+            return frames;
+        }
+    };
+}
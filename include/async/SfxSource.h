@@ -0,0 +1,265 @@
+#pragma once
+
+#include <Arduino.h>
+#include <math.h>
+#include <async/AudioSource.h>
+#include <async/Oscillator.h>
+
+namespace async {
+    // sfxr-style effect description. Pitch values are relative to frequency:
+    // slide in 1/256 octave per second, deltaSlide in 1/256 octave per second
+    // squared, vibratoDepth in 1/256 octave, change in cents.
+    struct SfxParams {
+        uint8_t waveform;       // Waveform
+        uint8_t volume;         // 0-255
+        uint16_t attackMs;
+        uint16_t sustainMs;
+        uint16_t decayMs;
+        uint8_t punch;          // extra level at the start of the sustain, 255 doubles it
+        uint16_t frequency;     // Hz
+        uint16_t minFrequency;  // a falling slide ends the effect below this, 0 = never
+        int16_t slide;
+        int16_t deltaSlide;
+        uint8_t vibratoDepth;
+        uint8_t vibratoRate;    // 0.1 Hz
+        int16_t change;         // pitch jump after changeMs
+        uint16_t changeMs;
+        uint16_t repeatMs;      // restarts the pitch sweep, 0 = off
+        uint16_t lowPass;       // one-pole cutoff in Hz, 0 = off
+        uint16_t highPass;      // one-pole cutoff in Hz, 0 = off
+    };
+
+    namespace SfxPresets {
+        inline SfxParams coin() {
+            SfxParams params = {WAVE_SQUARE, 160, 0, 40, 220, 128, 988, 0, 0, 0, 0, 0, 500, 60, 0, 0, 0};
+            return params;
+        }
+
+        inline SfxParams blip() {
+            SfxParams params = {WAVE_SQUARE, 140, 0, 30, 40, 0, 880, 0, 0, 0, 0, 0, 0, 0, 0, 6000, 0};
+            return params;
+        }
+
+        inline SfxParams laser() {
+            SfxParams params = {WAVE_SAW, 150, 0, 60, 140, 64, 1800, 120, -6 * 256, 0, 0, 0, 0, 0, 0, 0, 200};
+            return params;
+        }
+
+        inline SfxParams explosion() {
+            SfxParams params = {WAVE_NOISE, 200, 0, 80, 500, 200, 2000, 0, -2 * 256, 0, 0, 0, 0, 0, 0, 3000, 0};
+            return params;
+        }
+
+        inline SfxParams hit() {
+            SfxParams params = {WAVE_NOISE, 180, 0, 20, 120, 160, 1200, 0, -4 * 256, 0, 0, 0, 0, 0, 0, 0, 0};
+            return params;
+        }
+
+        inline SfxParams jump() {
+            SfxParams params = {WAVE_SQUARE, 140, 0, 60, 150, 0, 300, 0, 3 * 256, 0, 0, 0, 0, 0, 0, 0, 100};
+            return params;
+        }
+
+        inline SfxParams powerUp() {
+            SfxParams params = {WAVE_SQUARE, 140, 0, 120, 220, 0, 400, 0, 3 * 256, 0, 0, 0, 0, 0, 80, 0, 0};
+            return params;
+        }
+
+        inline SfxParams alarm() {
+            SfxParams params = {WAVE_SQUARE, 150, 5, 600, 60, 0, 800, 0, 0, 0, 40, 60, 0, 0, 0, 0, 0};
+            return params;
+        }
+    }
+
+    // Renders an SfxParams effect on a WavPlayer track. Parameters are turned
+    // into fixed-point steps once in set(); rendering is integer only, with
+    // pitch, vibrato and envelope updated every CONTROL_RATE samples.
+    class SfxSource : public AudioSource {
+    public:
+        static const int CONTROL_RATE = 16;
+
+    private:
+        Oscillator oscillator;
+        const uint32_t sampleRate;
+        uint32_t baseIncrement;
+        uint32_t minIncrement;
+
+        // Pitch offsets are Q32 octaves
+        int64_t slideStep;
+        int64_t slideAccel;
+        int64_t changeOffset;
+        int64_t vibratoDepth;
+        uint32_t vibratoStep;
+        uint32_t changeAt;
+        uint32_t repeatEvery;
+
+        uint32_t attack;
+        uint32_t sustain;
+        uint32_t decay;
+        uint32_t length;
+        int32_t punch;
+        int32_t volume;
+        int32_t lowPassCoef;
+        int32_t highPassCoef;
+
+        uint32_t position;
+        uint32_t sweepPosition;
+        int64_t pitch;
+        int64_t slide;
+        uint32_t vibratoPhase;
+        int32_t gain;
+        int32_t lowPassState;
+        int32_t highPassState;
+        bool finished;
+
+        static int32_t onePole(uint16_t cutoff, uint32_t sampleRate) {
+            if (cutoff == 0) return 0;
+            float coef = 1.0f - expf(-2.0f * (float)M_PI * cutoff / sampleRate);
+            return constrain((int32_t)(coef * (1 << 15)), (int32_t)1, (int32_t)32767);
+        }
+
+        // base * 2^octaves for a Q16 octave offset; the fraction uses a
+        // quadratic fit of 2^f that is within 0.3%
+        static uint32_t scale(uint32_t base, int32_t octaves) {
+            int32_t whole = octaves >> 16;
+            uint32_t f = octaves & 0xFFFF;
+            uint64_t mantissa = 65536 + ((f * (43024 + ((22512 * f) >> 16))) >> 16);
+            uint64_t value = (uint64_t)base * mantissa >> 16;
+            if (whole >= 0) {
+                value = whole >= 32 ? UINT32_MAX : value << whole;
+            } else {
+                value = whole <= -32 ? 0 : value >> -whole;
+            }
+            return value > 0x7FFFFFFFUL ? 0x7FFFFFFFUL : (uint32_t)value;
+        }
+
+        void restartSweep() {
+            sweepPosition = 0;
+            pitch = 0;
+            slide = slideStep;
+        }
+
+        void update() {
+            if (repeatEvery && sweepPosition >= repeatEvery) restartSweep();
+
+            int64_t offset = pitch;
+            if (changeAt && sweepPosition >= changeAt) offset += changeOffset;
+            if (vibratoDepth) {
+                const int16_t* sine = Wavetables::sine();
+                offset += (sine[vibratoPhase >> (32 - Wavetables::TABLE_BITS)] * vibratoDepth) >> 15;
+                vibratoPhase += vibratoStep;
+            }
+
+            uint32_t increment = scale(baseIncrement, (int32_t)(offset >> 16));
+            if (minIncrement && slide < 0 && increment < minIncrement) {
+                finished = true;
+                return;
+            }
+            oscillator.setIncrement(max(increment, (uint32_t)1));
+
+            pitch += slide;
+            slide += slideAccel;
+            sweepPosition += CONTROL_RATE;
+
+            int32_t level;
+            if (position < attack) {
+                level = (int32_t)((uint64_t)position * 32768 / attack);
+            } else if (position < attack + sustain) {
+                uint32_t left = attack + sustain - position;
+                level = 32768 + (int32_t)((uint64_t)punch * left / sustain);
+            } else {
+                uint32_t left = length - position;
+                level = (int32_t)((uint64_t)left * 32768 / decay);
+            }
+            gain = min((level * volume) / 255, (int32_t)65535);
+        }
+
+    public:
+        SfxSource(uint32_t sampleRate = 32000)
+            : sampleRate(sampleRate), attack(0), sustain(0), decay(0), length(0), position(0), finished(true) {}
+
+        // Copies what it needs; params can be a temporary
+        void set(const SfxParams& params) {
+            float blockSeconds = (float)CONTROL_RATE / sampleRate;
+            const float q32 = 4294967296.0f;
+
+            oscillator.setWaveform(params.waveform <= WAVE_NOISE ? (Waveform)params.waveform : WAVE_SQUARE);
+            baseIncrement = Oscillator::incrementFor(params.frequency, sampleRate);
+            minIncrement = Oscillator::incrementFor(params.minFrequency, sampleRate);
+
+            slideStep = (int64_t)(params.slide / 256.0f * blockSeconds * q32);
+            slideAccel = (int64_t)(params.deltaSlide / 256.0f * blockSeconds * blockSeconds * q32);
+            changeOffset = (int64_t)(params.change / 1200.0f * q32);
+            vibratoDepth = (int64_t)params.vibratoDepth << 24;
+            vibratoStep = (uint32_t)(params.vibratoRate / 10.0f * blockSeconds * q32);
+
+            attack = (uint32_t)((uint64_t)params.attackMs * sampleRate / 1000);
+            sustain = (uint32_t)((uint64_t)params.sustainMs * sampleRate / 1000);
+            decay = max((uint32_t)((uint64_t)params.decayMs * sampleRate / 1000), (uint32_t)1);
+            length = attack + sustain + decay;
+            changeAt = params.change ? max((uint32_t)((uint64_t)params.changeMs * sampleRate / 1000), (uint32_t)1) : 0;
+            repeatEvery = (uint32_t)((uint64_t)params.repeatMs * sampleRate / 1000);
+
+            punch = params.punch * 128;
+            volume = params.volume;
+            lowPassCoef = onePole(params.lowPass, sampleRate);
+            highPassCoef = onePole(params.highPass, sampleRate);
+
+            rewind();
+        }
+
+        size_t read(int16_t* samples, size_t frames) override {
+            size_t done = 0;
+
+            while (done < frames && position < length) {
+                if (position % CONTROL_RATE == 0) {
+                    update();
+                    if (finished) {
+                        length = position;
+                        break;
+                    }
+                }
+
+                size_t chunk = min(frames - done, (size_t)(CONTROL_RATE - position % CONTROL_RATE));
+                chunk = min(chunk, (size_t)(length - position));
+
+                for (size_t i = 0; i < chunk; i++) {
+                    int32_t sample = oscillator.next();
+                    if (lowPassCoef) {
+                        lowPassState += ((sample - lowPassState) * lowPassCoef) >> 15;
+                        sample = lowPassState;
+                    }
+                    if (highPassCoef) {
+                        highPassState += ((sample - highPassState) * highPassCoef) >> 15;
+                        sample -= highPassState;
+                    }
+                    // Up to twice full scale after the high-pass, times gain up to 65535
+                    sample = (int32_t)(((int64_t)sample * gain) >> 15);
+                    samples[done + i] = sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : (int16_t)sample;
+                }
+
+                done += chunk;
+                position += chunk;
+            }
+            return done;
+        }
+
+        size_t remaining() const override {
+            return length - position;
+        }
+
+        // Restarts the effect; the length is restored if a slide cut it short
+        bool rewind() override {
+            length = attack + sustain + decay;
+            position = 0;
+            vibratoPhase = 0;
+            gain = 0;
+            lowPassState = 0;
+            highPassState = 0;
+            finished = false;
+            restartSweep();
+            oscillator.reset();
+            return length > 0;
+        }
+    };
+}
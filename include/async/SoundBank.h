@@ -0,0 +1,256 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/WavAsset.h>
+
+#ifdef ESP32
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#endif
+
+#ifndef ARDUINO
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace async {
+    enum SoundFormat {
+        SOUND_PCM16 = 1
+    };
+
+    // One directory record. offset is from the start of the bank, length is
+    // the stored payload in bytes. Silence trimmed off either end of the sound
+    // is only counted, in frames; loop points are in frames of the whole
+    // sound, loopEnd 0 means no loop points.
+    struct SoundBankEntry {
+        uint32_t id;
+        uint16_t format;
+        uint16_t channels;
+        uint32_t sampleRate;
+        uint32_t offset;
+        uint32_t length;
+        uint32_t loopStart;
+        uint32_t loopEnd;
+        uint32_t leadingSilence;
+        uint32_t trailingSilence;
+    };
+
+    // Packed sound bank, all fields little-endian (tools/soundbank.py writes it):
+    //
+    //   header     "SBNK", u16 version, u16 count, u32 total size, u32 alignment
+    //   directory  count records of 40 bytes, sorted by id:
+    //              u32 id, u16 format, u16 channels, u32 rate, u32 offset,
+    //              u32 length, u32 loop start, u32 loop end,
+    //              u32 leading silence, u32 trailing silence, u32 reserved
+    //   payloads   each starting on an alignment boundary
+    //
+    // The bank is used where it lies: a mapped flash partition on ESP32, a
+    // mapped file on a host, or any array in memory. Sounds play from it
+    // without copying.
+    class SoundBank {
+    public:
+        static const uint16_t VERSION = 1;
+        static const size_t HEADER_SIZE = 16;
+        static const size_t ENTRY_SIZE = 40;
+
+    private:
+        const uint8_t* base;
+        size_t size;
+        uint16_t count;
+#ifdef ESP32
+        spi_flash_mmap_handle_t flashHandle;
+        bool flashMapped;
+#endif
+#ifndef ARDUINO
+        void* fileMapping;
+        size_t fileSize;
+#endif
+
+        static uint32_t readLE32(const uint8_t* p) {
+            return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+
+        static uint16_t readLE16(const uint8_t* p) {
+            return p[0] | (p[1] << 8);
+        }
+
+        const uint8_t* record(size_t index) const {
+            return base + HEADER_SIZE + index * ENTRY_SIZE;
+        }
+
+    public:
+        SoundBank() : base(nullptr), size(0), count(0)
+#ifdef ESP32
+            , flashHandle(0), flashMapped(false)
+#endif
+#ifndef ARDUINO
+            , fileMapping(nullptr), fileSize(0)
+#endif
+        {}
+
+        SoundBank(const SoundBank&) = delete;
+        SoundBank& operator=(const SoundBank&) = delete;
+
+        ~SoundBank() {
+            close();
+        }
+
+        // Checks the header and that the directory and every payload lie inside the bank
+        bool open(const uint8_t* data, size_t length) {
+            base = nullptr;
+            count = 0;
+            if (!data || length < HEADER_SIZE || memcmp(data, "SBNK", 4) != 0) return false;
+            if (readLE16(data + 4) != VERSION) return false;
+
+            uint16_t entries = readLE16(data + 6);
+            size_t declared = readLE32(data + 8);
+            if (declared > length || HEADER_SIZE + (size_t)entries * ENTRY_SIZE > declared) return false;
+
+            uint32_t previous = 0;
+            for (size_t i = 0; i < entries; i++) {
+                const uint8_t* p = data + HEADER_SIZE + i * ENTRY_SIZE;
+                uint32_t id = readLE32(p);
+                uint32_t offset = readLE32(p + 12);
+                uint32_t bytes = readLE32(p + 16);
+                if (i > 0 && id <= previous) return false;
+                if (offset > declared || bytes > declared - offset) return false;
+                previous = id;
+            }
+
+            base = data;
+            size = declared;
+            count = entries;
+            return true;
+        }
+
+#ifdef ESP32
+        // Maps a data partition (e.g. subtype 0x40 labelled "sounds") into the data address space
+        bool openPartition(const char* label) {
+            close();
+            const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+            if (!partition) return false;
+
+            const void* mapped = nullptr;
+            if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &mapped, &flashHandle) != ESP_OK) return false;
+            flashMapped = true;
+
+            if (!open(static_cast<const uint8_t*>(mapped), partition->size)) {
+                close();
+                return false;
+            }
+            return true;
+        }
+#endif
+
+#ifndef ARDUINO
+        bool openFile(const char* path) {
+            close();
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0) return false;
+
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size == 0) {
+                ::close(fd);
+                return false;
+            }
+
+            void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (mapped == MAP_FAILED) return false;
+            fileMapping = mapped;
+            fileSize = info.st_size;
+
+            if (!open(static_cast<const uint8_t*>(mapped), fileSize)) {
+                close();
+                return false;
+            }
+            return true;
+        }
+#endif
+
+        void close() {
+            base = nullptr;
+            size = 0;
+            count = 0;
+#ifdef ESP32
+            if (flashMapped) {
+                spi_flash_munmap(flashHandle);
+                flashMapped = false;
+            }
+#endif
+#ifndef ARDUINO
+            if (fileMapping) {
+                munmap(fileMapping, fileSize);
+                fileMapping = nullptr;
+                fileSize = 0;
+            }
+#endif
+        }
+
+        bool isOpen() const {
+            return base != nullptr;
+        }
+
+        size_t getCount() const {
+            return count;
+        }
+
+        // Binary search over the sorted directory
+        bool find(uint32_t id, SoundBankEntry& entry) const {
+            size_t low = 0;
+            size_t high = count;
+            while (low < high) {
+                size_t middle = (low + high) / 2;
+                uint32_t current = readLE32(record(middle));
+                if (current < id) {
+                    low = middle + 1;
+                } else if (current > id) {
+                    high = middle;
+                } else {
+                    return entryAt(middle, entry);
+                }
+            }
+            return false;
+        }
+
+        bool entryAt(size_t index, SoundBankEntry& entry) const {
+            if (index >= count) return false;
+            const uint8_t* p = record(index);
+            entry.id = readLE32(p);
+            entry.format = readLE16(p + 4);
+            entry.channels = readLE16(p + 6);
+            entry.sampleRate = readLE32(p + 8);
+            entry.offset = readLE32(p + 12);
+            entry.length = readLE32(p + 16);
+            entry.loopStart = readLE32(p + 20);
+            entry.loopEnd = readLE32(p + 24);
+            entry.leadingSilence = readLE32(p + 28);
+            entry.trailingSilence = readLE32(p + 32);
+            return true;
+        }
+
+        const uint8_t* payload(const SoundBankEntry& entry) const {
+            return base ? base + entry.offset : nullptr;
+        }
+
+        // PCM sounds as a WavAsset for WavPlayer::play/loop; anything else
+        // (or a missing id) comes back invalid
+        WavAsset asset(uint32_t id) const {
+            SoundBankEntry entry;
+            if (!find(id, entry) || entry.format != SOUND_PCM16) return WavAsset{nullptr, 0, 0, 0, 0, 0, 0, 0};
+            return WavAsset{payload(entry), entry.length, entry.sampleRate, 1, entry.channels, 16,
+                entry.leadingSilence, entry.trailingSilence};
+        }
+
+        // Points source at a PCM sound in place, with its loop points
+        bool openSound(uint32_t id, PcmSource& source) const {
+            SoundBankEntry entry;
+            if (!find(id, entry) || entry.format != SOUND_PCM16 || entry.channels != 1) return false;
+            source.open(payload(entry), entry.length / sizeof(int16_t), entry.loopStart, entry.loopEnd,
+                entry.leadingSilence, entry.trailingSilence);
+            return true;
+        }
+    };
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/MidiInstrument.h>
+#include <async/Oscillator.h>
+
+namespace async {
+    // Linear ADSR in Q15, advanced once per CONTROL_RATE samples so the
+    // per-sample cost is one multiply.
+    class Envelope {
+    public:
+        enum Stage {
+            IDLE,
+            ATTACK,
+            DECAY,
+            SUSTAIN,
+            RELEASE
+        };
+
+    private:
+        Stage stage;
+        int32_t level;
+        int32_t attackStep;
+        int32_t decayStep;
+        int32_t sustainLevel;
+        int32_t releaseStep;
+
+        static int32_t stepFor(float ms, uint32_t controlRate) {
+            float steps = ms * controlRate / 1000.0f;
+            if (steps < 1.0f) return 1 << 15;
+            return max((int32_t)((1 << 15) / steps), (int32_t)1);
+        }
+
+    public:
+        Envelope() : stage(IDLE), level(0), attackStep(1 << 15), decayStep(1 << 15),
+            sustainLevel(1 << 15), releaseStep(1 << 15) {}
+
+        // Times are in ms, sustain is a fraction of the peak; controlRate is updates per second
+        void configure(float attackMs, float decayMs, float sustain, float releaseMs, uint32_t controlRate) {
+            attackStep = stepFor(attackMs, controlRate);
+            decayStep = stepFor(decayMs, controlRate);
+            sustainLevel = (int32_t)(constrain(sustain, 0.0f, 1.0f) * (1 << 15));
+            releaseStep = stepFor(releaseMs, controlRate);
+        }
+
+        void noteOn() {
+            stage = ATTACK;
+        }
+
+        void noteOff() {
+            if (stage != IDLE) stage = RELEASE;
+        }
+
+        void kill() {
+            stage = IDLE;
+            level = 0;
+        }
+
+        Stage getStage() const { return stage; }
+        int32_t getLevel() const { return level; }
+
+        int32_t update() {
+            switch (stage) {
+                case ATTACK:
+                    level += attackStep;
+                    if (level >= (1 << 15)) {
+                        level = 1 << 15;
+                        stage = DECAY;
+                    }
+                    break;
+                case DECAY:
+                    level -= decayStep;
+                    if (level <= sustainLevel) {
+                        level = sustainLevel;
+                        stage = SUSTAIN;
+                    }
+                    break;
+                case RELEASE:
+                    level -= releaseStep;
+                    if (level <= 0) {
+                        level = 0;
+                        stage = IDLE;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            return level;
+        }
+    };
+
+    // Polyphonic synth source: VOICES oscillators with ADSR and velocity,
+    // played with noteOn/noteOff by MIDI note number. A new note takes a free
+    // voice, then the quietest releasing one, then the oldest.
+    template <int VOICES = 8>
+    class Synth : public MidiInstrument {
+    public:
+        static const int CONTROL_RATE = 16;
+
+    private:
+        struct Voice {
+            Oscillator oscillator;
+            Envelope envelope;
+            uint8_t note;
+            int32_t velocity;
+            int32_t gain;
+            uint32_t age;
+        };
+
+        Voice voices[VOICES];
+        const uint32_t sampleRate;
+        uint32_t noteCounter;
+        int32_t masterGain;
+        int16_t controlPhase;
+
+        Voice& allocate(uint8_t note) {
+            // Retrigger the same note in place, else take a free voice
+            for (int i = 0; i < VOICES; i++) {
+                if (voices[i].note == note && voices[i].envelope.getStage() != Envelope::IDLE) return voices[i];
+            }
+            for (int i = 0; i < VOICES; i++) {
+                if (voices[i].envelope.getStage() == Envelope::IDLE) return voices[i];
+            }
+
+            Voice* best = &voices[0];
+            for (int i = 0; i < VOICES; i++) {
+                Voice& voice = voices[i];
+                bool releasing = voice.envelope.getStage() == Envelope::RELEASE;
+                bool bestReleasing = best->envelope.getStage() == Envelope::RELEASE;
+                if (releasing && (!bestReleasing || voice.envelope.getLevel() < best->envelope.getLevel())) {
+                    best = &voice;
+                } else if (!bestReleasing && !releasing && voice.age < best->age) {
+                    best = &voice;
+                }
+            }
+            return *best;
+        }
+
+    public:
+        Synth(uint32_t sampleRate = 32000, Waveform waveform = WAVE_SAW)
+            : sampleRate(sampleRate), noteCounter(0), masterGain((1 << 15) / 4), controlPhase(0) {
+            for (int i = 0; i < VOICES; i++) {
+                voices[i].oscillator.setWaveform(waveform);
+                voices[i].note = 0xFF;
+                voices[i].velocity = 0;
+                voices[i].gain = 0;
+                voices[i].age = 0;
+            }
+            setEnvelope(5.0f, 100.0f, 0.7f, 200.0f);
+        }
+
+        // MIDI note number to Hz, A4 = 440 Hz
+        static float frequencyOf(uint8_t note) {
+            return 440.0f * powf(2.0f, ((int)note - 69) / 12.0f);
+        }
+
+        void setWaveform(Waveform waveform) {
+            for (int i = 0; i < VOICES; i++) voices[i].oscillator.setWaveform(waveform);
+        }
+
+        void setEnvelope(float attackMs, float decayMs, float sustain, float releaseMs) {
+            for (int i = 0; i < VOICES; i++) {
+                voices[i].envelope.configure(attackMs, decayMs, sustain, releaseMs, sampleRate / CONTROL_RATE);
+            }
+        }
+
+        // Output level; the default leaves headroom for four full voices
+        void setLevel(float level) {
+            masterGain = (int32_t)(constrain(level, 0.0f, 1.0f) * (1 << 15));
+        }
+
+        void noteOn(uint8_t note, uint8_t velocity = 127) {
+            if (velocity == 0) {
+                noteOff(note);
+                return;
+            }
+            Voice& voice = allocate(note);
+            voice.note = note;
+            voice.velocity = ((int32_t)velocity << 15) / 127;
+            voice.age = ++noteCounter;
+            voice.oscillator.setFrequency(frequencyOf(note), sampleRate);
+            voice.envelope.noteOn();
+        }
+
+        void noteOff(uint8_t note) {
+            for (int i = 0; i < VOICES; i++) {
+                if (voices[i].note == note) voices[i].envelope.noteOff();
+            }
+        }
+
+        // MIDI channel messages; every channel but the drum channel (10) plays the same voices
+        void noteOn(uint8_t channel, uint8_t note, uint8_t velocity) override {
+            if (channel != 9) noteOn(note, velocity);
+        }
+
+        void noteOff(uint8_t channel, uint8_t note) override {
+            if (channel != 9) noteOff(note);
+        }
+
+        void allNotesOff() override {
+            for (int i = 0; i < VOICES; i++) voices[i].envelope.noteOff();
+        }
+
+        int activeVoices() const {
+            int count = 0;
+            for (int i = 0; i < VOICES; i++) {
+                if (voices[i].envelope.getStage() != Envelope::IDLE) count++;
+            }
+            return count;
+        }
+
+        // Never ends: a track playing the synth stays live and outputs silence
+        // while no voice is sounding
+        size_t read(int16_t* samples, size_t frames) override {
+            size_t done = 0;
+            while (done < frames) {
+                if (controlPhase == 0) {
+                    for (int v = 0; v < VOICES; v++) {
+                        Voice& voice = voices[v];
+                        voice.gain = (((voice.envelope.update() * voice.velocity) >> 15) * masterGain) >> 15;
+                    }
+                }
+
+                size_t chunk = min(frames - done, (size_t)(CONTROL_RATE - controlPhase));
+                int32_t mix[CONTROL_RATE];
+                memset(mix, 0, chunk * sizeof(int32_t));
+
+                for (int v = 0; v < VOICES; v++) {
+                    Voice& voice = voices[v];
+                    if (voice.gain == 0) continue;
+                    for (size_t i = 0; i < chunk; i++) {
+                        mix[i] += (voice.oscillator.next() * voice.gain) >> 15;
+                    }
+                }
+
+                for (size_t i = 0; i < chunk; i++) {
+                    int32_t sample = mix[i];
+                    samples[done + i] = sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : (int16_t)sample;
+                }
+
+                done += chunk;
+                controlPhase = (controlPhase + chunk) % CONTROL_RATE;
+            }
+            return frames;
+        }
+    };
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/AudioSource.h>
+#include <async/Oscillator.h>
+#include <async/Notes.h>
+
+namespace async {
+    // Generated tone for a WavPlayer track, e.g. player.play(1, &beep) after
+    // beep.tone(NOTE_A5, 100). Starts and ends with a short ramp so it never clicks.
+    class ToneSource : public AudioSource {
+    private:
+        static const size_t RAMP_FRAMES = 64;
+
+        Oscillator oscillator;
+        const uint32_t sampleRate;
+        int32_t amplitude;
+        size_t length;
+        size_t position;
+        size_t ramp;
+
+    public:
+        ToneSource(uint32_t sampleRate = 32000, Waveform waveform = WAVE_SINE)
+            : sampleRate(sampleRate), amplitude(0), length(0), position(0), ramp(0) {
+            oscillator.setWaveform(waveform);
+        }
+
+        void setWaveform(Waveform waveform) {
+            oscillator.setWaveform(waveform);
+        }
+
+        // Frequency 0 is a rest; durationMs 0 plays until the track is stopped
+        void tone(uint32_t frequency, uint32_t durationMs = 0, float level = 1.0f) {
+            oscillator.setFrequency(frequency, sampleRate);
+            oscillator.reset();
+            amplitude = frequency ? (int32_t)(constrain(level, 0.0f, 1.0f) * 32767) : 0;
+            length = durationMs ? (size_t)((uint64_t)durationMs * sampleRate / 1000) : UNKNOWN_LENGTH;
+            position = 0;
+            ramp = min((size_t)RAMP_FRAMES, length / 2);
+        }
+
+        size_t read(int16_t* samples, size_t frames) override {
+            if (length != UNKNOWN_LENGTH) frames = min(frames, length - position);
+
+            for (size_t i = 0; i < frames; i++, position++) {
+                int32_t gain = amplitude;
+                if (position < ramp) {
+                    gain = gain * (int32_t)position / (int32_t)ramp;
+                } else if (length != UNKNOWN_LENGTH && length - position <= ramp) {
+                    gain = gain * (int32_t)(length - position - 1) / (int32_t)ramp;
+                }
+                samples[i] = (int16_t)((oscillator.next() * gain) >> 15);
+            }
+            return frames;
+        }
+
+        size_t remaining() const override {
+            return length == UNKNOWN_LENGTH ? UNKNOWN_LENGTH : length - position;
+        }
+
+        bool rewind() override {
+            position = 0;
+            oscillator.reset();
+            return true;
+        }
+    };
+}
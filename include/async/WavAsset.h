@@ -0,0 +1,248 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/AudioSource.h>
+
+namespace async {
+    // Format and PCM location of a WAV file embedded as a byte array, worked
+    // out at compile time. Declare assets with WAV_ASSET so unsupported files
+    // fail the build instead of playing noise. Leading and trailing silence is
+    // skipped: data and bytes cover the audible part, and the silent frames
+    // around it are only counted, so they cost no reads or mixing. The array
+    // itself is still stored whole.
+    struct WavAsset {
+        const uint8_t* data;
+        uint32_t bytes;
+        uint32_t sampleRate;
+        uint16_t format;
+        uint16_t channels;
+        uint16_t bitsPerSample;
+        uint32_t leadingSilence;
+        uint32_t trailingSilence;
+
+        constexpr bool valid() const {
+            return data != nullptr;
+        }
+
+        constexpr bool playable() const {
+            return valid() && format == 1 && channels == 1 && bitsPerSample == 16;
+        }
+
+        constexpr uint32_t storedFrames() const {
+            return channels && bitsPerSample ? bytes / (channels * (bitsPerSample / 8)) : 0;
+        }
+
+        constexpr uint32_t frames() const {
+            return leadingSilence + storedFrames() + trailingSilence;
+        }
+    };
+
+    // C++11 constexpr: single-expression functions, chunks are walked by recursion
+    namespace wav_constexpr {
+        constexpr uint32_t le16(const uint8_t* p, size_t offset) {
+            return p[offset] | (p[offset + 1] << 8);
+        }
+
+        constexpr uint32_t le32(const uint8_t* p, size_t offset) {
+            return p[offset] | (p[offset + 1] << 8) | ((uint32_t)p[offset + 2] << 16) | ((uint32_t)p[offset + 3] << 24);
+        }
+
+        constexpr uint32_t fourcc(char a, char b, char c, char d) {
+            return (uint8_t)a | ((uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+        }
+
+        // Offset of the chunk header with the given id, or size if there is none
+        constexpr size_t findChunk(const uint8_t* p, size_t size, size_t offset, uint32_t id) {
+            return offset + 8 > size ? size
+                : le32(p, offset) == id ? offset
+                : findChunk(p, size, offset + 8 + le32(p, offset + 4) + (le32(p, offset + 4) & 1), id);
+        }
+
+        constexpr bool isWave(const uint8_t* p, size_t size) {
+            return size >= 12 && le32(p, 0) == fourcc('R', 'I', 'F', 'F') && le32(p, 8) == fourcc('W', 'A', 'V', 'E');
+        }
+
+        // The data chunk's size clamped to what the array holds
+        constexpr uint32_t dataBytes(size_t size, size_t offset, uint32_t declared) {
+            return offset + 8 + declared > size ? (uint32_t)(size - offset - 8) : declared;
+        }
+
+        constexpr bool audible(const uint8_t* pcm, size_t index) {
+            return (pcm[index * 2] | pcm[index * 2 + 1]) != 0;
+        }
+
+        constexpr size_t firstAudible(const uint8_t* pcm, size_t from, size_t to);
+        constexpr size_t audibleEnd(const uint8_t* pcm, size_t from, size_t to);
+
+        constexpr size_t firstAudibleOr(const uint8_t* pcm, size_t found, size_t middle, size_t to) {
+            return found < middle ? found : firstAudible(pcm, middle, to);
+        }
+
+        // First non-zero sample in [from, to), or to. Searching by halves keeps
+        // the recursion shallow; the right half is only visited if the left is silent.
+        constexpr size_t firstAudible(const uint8_t* pcm, size_t from, size_t to) {
+            return to - from <= 1 ? (to > from && audible(pcm, from) ? from : to)
+                : firstAudibleOr(pcm, firstAudible(pcm, from, from + (to - from) / 2), from + (to - from) / 2, to);
+        }
+
+        constexpr size_t audibleEndOr(const uint8_t* pcm, size_t found, size_t from, size_t middle) {
+            return found > middle ? found : audibleEnd(pcm, from, middle);
+        }
+
+        // One past the last non-zero sample in [from, to), or from
+        constexpr size_t audibleEnd(const uint8_t* pcm, size_t from, size_t to) {
+            return to - from <= 1 ? (to > from && audible(pcm, from) ? to : from)
+                : audibleEndOr(pcm, audibleEnd(pcm, from + (to - from) / 2, to), from, from + (to - from) / 2);
+        }
+
+        constexpr WavAsset trimmed(const WavAsset& asset, size_t lead, size_t end) {
+            return WavAsset{asset.data + lead * 2, (uint32_t)((end - lead) * 2), asset.sampleRate, asset.format,
+                asset.channels, asset.bitsPerSample, (uint32_t)lead, (uint32_t)(asset.storedFrames() - end)};
+        }
+
+        constexpr WavAsset trimmedFrom(const WavAsset& asset, size_t lead) {
+            return trimmed(asset, lead, audibleEnd(asset.data, lead, asset.storedFrames()));
+        }
+
+        // Only mono 16-bit PCM is scanned; anything else is rejected by WAV_ASSET anyway
+        constexpr WavAsset trim(const WavAsset& asset) {
+            return asset.playable() ? trimmedFrom(asset, firstAudible(asset.data, 0, asset.storedFrames())) : asset;
+        }
+
+        constexpr WavAsset describe(const uint8_t* p, size_t size, size_t fmt, size_t data) {
+            return fmt + 24 > size || data >= size
+                ? WavAsset{nullptr, 0, 0, 0, 0, 0, 0, 0}
+                : WavAsset{p + data + 8, dataBytes(size, data, le32(p, data + 4)),
+                    le32(p, fmt + 12), (uint16_t)le16(p, fmt + 8), (uint16_t)le16(p, fmt + 10), (uint16_t)le16(p, fmt + 22), 0, 0};
+        }
+
+        constexpr WavAsset parse(const uint8_t* p, size_t size) {
+            return !isWave(p, size)
+                ? WavAsset{nullptr, 0, 0, 0, 0, 0, 0, 0}
+                : trim(describe(p, size, findChunk(p, size, 12, fourcc('f', 'm', 't', ' ')),
+                    findChunk(p, size, 12, fourcc('d', 'a', 't', 'a'))));
+        }
+    }
+
+    template <size_t N>
+    constexpr WavAsset wavAsset(const uint8_t (&file)[N]) {
+        return wav_constexpr::parse(file, N);
+    }
+
+    // Mono 16-bit PCM straight from memory: no header, no seek, no checks.
+    // Leading and trailing silence is virtual: it is produced without touching
+    // memory and reported through silentFrames() so the player can skip it.
+    // While looping it wraps from loopEnd back to loopStart (the whole sound by default).
+    class PcmSource : public AudioSource {
+    private:
+        const uint8_t* data;
+        size_t stored;
+        size_t lead;
+        size_t frames;
+        size_t position;
+        size_t loopStart;
+        size_t loopEnd;
+        bool looping;
+        uint32_t wraps;
+
+        size_t endOfPass() const {
+            return looping && position <= loopEnd ? loopEnd : frames;
+        }
+
+    public:
+        PcmSource() : data(nullptr), stored(0), lead(0), frames(0), position(0),
+            loopStart(0), loopEnd(0), looping(false), wraps(0) {}
+
+        PcmSource(const WavAsset& asset) : PcmSource() {
+            open(asset);
+        }
+
+        // count samples at samples, with leading/trailing silent frames around
+        // them; loop points count from the start of the leading silence.
+        // Samples are little-endian; memcpy keeps unaligned arrays safe.
+        void open(const uint8_t* samples, size_t count, size_t start = 0, size_t end = 0,
+            size_t leading = 0, size_t trailing = 0) {
+            data = samples;
+            stored = samples ? count : 0;
+            lead = leading;
+            frames = leading + stored + trailing;
+            position = 0;
+            wraps = 0;
+            loopEnd = end > start && end <= frames ? end : frames;
+            loopStart = end > start && end <= frames ? start : 0;
+        }
+
+        void open(const WavAsset& asset) {
+            open(asset.data, asset.storedFrames(), 0, 0, asset.leadingSilence, asset.trailingSilence);
+        }
+
+        size_t read(int16_t* samples, size_t count) override {
+            size_t done = 0;
+            while (done < count) {
+                size_t end = endOfPass();
+                if (position >= end) {
+                    if (!looping || loopEnd == loopStart) break;
+                    position = loopStart;
+                    wraps++;
+                    continue;
+                }
+
+                size_t chunk = min(count - done, end - position);
+                if (position < lead) {
+                    chunk = min(chunk, lead - position);
+                    memset(samples + done, 0, chunk * sizeof(int16_t));
+                } else if (position < lead + stored) {
+                    chunk = min(chunk, lead + stored - position);
+                    memcpy(samples + done, data + (position - lead) * sizeof(int16_t), chunk * sizeof(int16_t));
+                } else {
+                    memset(samples + done, 0, chunk * sizeof(int16_t));
+                }
+                position += chunk;
+                done += chunk;
+            }
+            return done;
+        }
+
+        size_t silentFrames() const override {
+            size_t end = endOfPass();
+            if (position >= end) return 0;
+            if (position < lead) return min(lead, end) - position;
+            if (position >= lead + stored) return end - position;
+            return 0;
+        }
+
+        size_t skip(size_t count) override {
+            count = min(count, silentFrames());
+            position += count;
+            return count;
+        }
+
+        uint32_t getLoopCount() const override {
+            return wraps;
+        }
+
+        size_t remaining() const override {
+            return looping ? UNKNOWN_LENGTH : frames - position;
+        }
+
+        bool rewind() override {
+            position = 0;
+            wraps = 0;
+            return frames > 0;
+        }
+
+        bool setLooping(bool enable) override {
+            looping = enable;
+            return true;
+        }
+    };
+}
+
+// Declares a constexpr WavAsset for an embedded WAV array (which must itself
+// be constexpr) and rejects anything WavPlayer can't play as-is. Trimming
+// only moves the pointer, so the silence still takes flash; pack sounds with
+// tools/soundbank.py to drop it from the image.
+#define WAV_ASSET(name, array) \
+    constexpr async::WavAsset name = async::wavAsset(array); \
+    static_assert(name.valid(), #array " is not a RIFF/WAVE file with fmt and data chunks"); \
+    static_assert(name.playable(), #array " must be mono 16-bit PCM")
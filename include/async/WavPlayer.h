@@ -2,33 +2,154 @@
 #include <driver/i2s.h>
 #include <async/Tick.h>
 #include <async/Stream.h>
+#include <async/AudioSource.h>
+#include <async/Decoders.h>
+#include <async/WavAsset.h>
 #include <async/Function.h>
+#include <async/Limiter.h>
+#include <async/AudioEffect.h>
+#include <async/DacDither.h>
 
 namespace async {
     enum WavPlayerEvent {
         TRACK_STARTED,
         TRACK_STOPPED,
         TRACK_PAUSED,
-        TRACK_RESUMED
+        TRACK_RESUMED,
+        TRACK_LOOPED,       // wrapped to its loop start
+        TRACK_UNDERRUN,     // decoder had nothing ready and decoded on the mix path
+        OUTPUT_UNDERRUN,    // trackNum -1: the output ran dry while playing
+        OUTPUT_BUFFER_LOW   // trackNum -1: less than a block left queued for output
+    };
+
+    enum WavPlayerOutput {
+        OUTPUT_I2S,         // external codec on the bck/ws/data pins
+        OUTPUT_BUILTIN_DAC  // ESP32 8-bit DAC, same signal on GPIO25 and GPIO26
     };
 
     typedef Function<void(int trackNum, WavPlayerEvent event)> WavPlayerCallback;
 
     class WavPlayer : public Tick {
     private:
+        static const int QUEUE_SIZE = 4;
+
+        // Stream-based sources are opened into one of the track's decoder
+        // slots: enough for the current source, a full queue and a
+        // replacement being opened while the current one still plays.
+        // Slots are small and fixed; open MP3s across all tracks are capped
+        // by ASYNC_AUDIO_MP3_DECODERS, beyond which play/enqueue fail.
+        static const int DECODER_SLOTS = QUEUE_SIZE + 2;
+
+        struct QueuedSource {
+            AudioSource* source;
+        };
+
         struct AudioTrack {
-            Stream* stream;
+            AudioSource* source;
+            DecoderSlot decoders[DECODER_SLOTS];
+            PcmSource pcm;
             bool isPlaying;
             bool isPaused;
             float volume;
             float fadeVolume;
             int16_t* buffer;
-            size_t bufferPos;
+            size_t bufferLen;
+            bool silent;
             bool loop;
+            uint8_t bus;
+            QueuedSource queue[QUEUE_SIZE];
+            uint8_t queueHead;
+            uint8_t queueCount;
+            size_t crossfadeFrames;
+            size_t fadeLength;
+            size_t fadePos;
+            uint32_t underruns;
+        };
+
+        struct MixBus {
+            float volume;
+            bool muted;
+            AudioEffect* effect;
+            int32_t* accum;
+        };
+
+        // Gain envelope on target buses driven by a source track or bus
+        struct Ducker {
+            bool enabled;
+            int8_t sourceTrack;
+            int8_t sourceBus;
+            uint8_t targetBuses;
+            int32_t threshold;
+            int32_t depth;
+            int32_t attackCoef;
+            int32_t releaseCoef;
+            int32_t envelope;
+            int32_t gain;
+            int32_t prevGain;
         };
 
+        // Fire-and-forget instance of a shared asset: a cursor over its
+        // samples plus a gain, mixed straight from the asset's memory
+        struct Voice {
+            PcmSource cursor;
+            int32_t gain;
+            uint8_t bus;
+            bool active;
+            uint32_t serial;
+        };
+        
+        struct PendingEvent {
+            int8_t trackNum;
+            uint8_t event;
+            uint32_t sample;
+        };
+        
+        static const uint8_t EVENT_RING_SIZE = 32;
+
         static const int MAX_TRACKS = 4;
+        static const int MAX_BUSES = 4;
+        static const int MAX_VOICES = 16;
+        static const int FADING_VOICES = 4;
         AudioTrack tracks[MAX_TRACKS];
+        MixBus buses[MAX_BUSES];
+        Voice voices[MAX_VOICES];
+        // Stolen voices, ramped out over one block instead of cut
+        Voice fadingVoices[FADING_VOICES];
+        uint32_t voiceSerial;
+        
+        // Single-producer ring filled from an ISR, drained by tick()
+        struct TriggerRequest {
+            const WavAsset* asset;
+            uint8_t volume;
+            uint8_t bus;
+        };
+        
+        static const uint8_t TRIGGER_RING_SIZE = 16;
+        TriggerRequest triggerRing[TRIGGER_RING_SIZE];
+        volatile uint8_t triggerHead;
+        volatile uint8_t triggerTail;
+        
+        int dmaBufCount;
+        int dmaBufLen;
+        size_t expressChunk;
+        
+        PendingEvent events[EVENT_RING_SIZE];
+        uint8_t eventHead;
+        uint8_t eventCount;
+        uint32_t droppedEvents;
+        uint32_t eventSample;
+        
+        // Output clock: frames handed to i2s_write against time, to tell how
+        // much is still queued for DMA
+        uint32_t outputFrames;
+        uint32_t anchorFrames;
+        uint32_t anchorMicros;
+        bool outputRunning;
+        bool outputLow;
+        
+        WavPlayerOutput outputMode;
+        uint16_t* dacBuffer;
+        DacDither dither;
         
         const int bckPin;
         const int wsPin;
@@ -36,48 +157,109 @@ namespace async {
         const uint32_t sampleRate;
         bool initialized;
         int16_t* mixBuffer;
+        int32_t* mixAccum;
+        int16_t* scratchBuffer;
         const size_t mixBufferSize = 512;
         WavPlayerCallback eventCallback;
+        Limiter limiter;
+        bool limiterEnabled;
+        Ducker ducker;
         
     public:
         WavPlayer(int bck = 26, int ws = 25, int dataOut = 22, uint32_t sampleRate = 32000) 
-            : bckPin(bck), wsPin(ws), dataOutPin(dataOut), 
-            initialized(false), eventCallback(nullptr), sampleRate(sampleRate) {
+            : voiceSerial(0), triggerHead(0), triggerTail(0), dmaBufCount(8), dmaBufLen(1024), expressChunk(0),
+            eventHead(0), eventCount(0), droppedEvents(0), eventSample(0),
+            outputFrames(0), anchorFrames(0), anchorMicros(0), outputRunning(false), outputLow(false),
+            outputMode(OUTPUT_I2S), dacBuffer(nullptr),
+            bckPin(bck), wsPin(ws), dataOutPin(dataOut), sampleRate(sampleRate),
+            initialized(false), eventCallback(nullptr), limiterEnabled(false) {
             
             for (int i = 0; i < MAX_TRACKS; i++) {
-                tracks[i] = {
-                    .stream = nullptr,
-                    .isPlaying = false,
-                    .isPaused = false,
+                AudioTrack& track = tracks[i];
+                track.source = nullptr;
+                track.isPlaying = false;
+                track.isPaused = false;
+                track.volume = 1.0f;
+                track.fadeVolume = 0.0f;
+                track.buffer = nullptr;
+                track.bufferLen = 0;
+                track.silent = false;
+                track.loop = false;
+                track.bus = 0;
+                track.queueHead = 0;
+                track.queueCount = 0;
+                track.crossfadeFrames = 0;
+                track.fadeLength = 0;
+                track.fadePos = 0;
+                track.underruns = 0;
+            }
+            
+            ducker = {
+                .enabled = false,
+                .sourceTrack = -1,
+                .sourceBus = -1,
+                .targetBuses = 0,
+                .threshold = 0,
+                .depth = UNITY_GAIN,
+                .attackCoef = UNITY_GAIN,
+                .releaseCoef = UNITY_GAIN,
+                .envelope = 0,
+                .gain = UNITY_GAIN,
+                .prevGain = UNITY_GAIN
+            };
+            
+            for (int i = 0; i < MAX_BUSES; i++) {
+                buses[i] = {
                     .volume = 1.0f,
-                    .fadeVolume = 0.0f,
-                    .buffer = nullptr,
-                    .bufferPos = 0,
-                    .loop = false
+                    .muted = false,
+                    .effect = nullptr,
+                    .accum = nullptr
                 };
             }
             
+            for (int i = 0; i < MAX_VOICES; i++) {
+                voices[i].gain = UNITY_GAIN;
+                voices[i].bus = 0;
+                voices[i].active = false;
+                voices[i].serial = 0;
+            }
+            for (int i = 0; i < FADING_VOICES; i++) fadingVoices[i].active = false;
+            
             mixBuffer = (int16_t*)malloc(mixBufferSize * sizeof(int16_t));
+            mixAccum = (int32_t*)malloc(mixBufferSize * sizeof(int32_t));
+            scratchBuffer = (int16_t*)malloc(mixBufferSize * sizeof(int16_t));
         }
         
         ~WavPlayer() {
             cancel();
             free(mixBuffer);
+            free(mixAccum);
+            free(scratchBuffer);
+            for (int i = 0; i < MAX_BUSES; i++) {
+                free(buses[i].accum);
+            }
         }
         
         bool start() override {
             Serial.println("start");
             if (initialized) return true;
             
+            // The DAC takes unsigned samples from the high byte of both channels
+            bool dac = outputMode == OUTPUT_BUILTIN_DAC;
+            int mode = I2S_MODE_MASTER | I2S_MODE_TX;
+#if SOC_I2S_SUPPORTS_DAC
+            if (dac) mode |= I2S_MODE_DAC_BUILT_IN;
+#endif
+            
             i2s_config_t i2s_config = {
-                .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
+                .mode = (i2s_mode_t)mode,
                 .sample_rate = sampleRate,
                 .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
-                .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
-                .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+                .channel_format = dac ? I2S_CHANNEL_FMT_RIGHT_LEFT : I2S_CHANNEL_FMT_ONLY_LEFT,
+                .communication_format = dac ? I2S_COMM_FORMAT_STAND_MSB : I2S_COMM_FORMAT_STAND_I2S,
                 .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-                .dma_buf_count = 8,
-                .dma_buf_len = 1024,
+                .dma_buf_count = dmaBufCount,
+                .dma_buf_len = dmaBufLen,
                 .use_apll = false,
                 .tx_desc_auto_clear = true,
             };
@@ -93,15 +275,27 @@ namespace async {
                 return false;
             }
             
+#if SOC_I2S_SUPPORTS_DAC
+            if (dac) {
+                dacBuffer = (uint16_t*)malloc(mixBufferSize * 2 * sizeof(uint16_t));
+                if (!dacBuffer || i2s_set_pin(I2S_NUM_0, NULL) != ESP_OK
+                    || i2s_set_dac_mode(I2S_DAC_CHANNEL_BOTH_EN) != ESP_OK) {
+                    releaseOutput();
+                    return false;
+                }
+                dither.reset();
+            } else
+#endif
             if (i2s_set_pin(I2S_NUM_0, &pin_config) != ESP_OK) {
-                i2s_driver_uninstall(I2S_NUM_0);
+                releaseOutput();
                 return false;
             }
             
             for (int i = 0; i < MAX_TRACKS; i++) {
                 tracks[i].buffer = (int16_t*)malloc(mixBufferSize * sizeof(int16_t));
                 if (!tracks[i].buffer) {
-                    cancel();
+                    // Not initialized yet, so cancel() would leave all this behind
+                    releaseOutput();
                     return false;
                 }
             }
@@ -114,88 +308,260 @@ namespace async {
             Serial.println("cancel");
             if (!initialized) return false;
             
-            for (int i = 0; i < MAX_TRACKS; i++) {
-                stop(i);
-                free(tracks[i].buffer);
-                tracks[i].buffer = nullptr;
-            }
-            
-            i2s_driver_uninstall(I2S_NUM_0);
+            for (int i = 0; i < MAX_TRACKS; i++) stop(i);
+            stopVoices();
+            releaseOutput();
             initialized = false;
+            outputRunning = false;
+            
+            // Delivered now rather than after the next start(); callbacks
+            // can't restart tracks from here, and what they raise is dropped
+            dispatchEvents();
+            eventHead = 0;
+            eventCount = 0;
             return true;
         }
         
+        // WAV, QOA or MP3, whichever the stream starts with (and is compiled in).
+        // Files at a rate other than the player's are refused.
         bool play(int trackNum, Stream* stream) {
-            if (trackNum < 0 || trackNum >= MAX_TRACKS || !initialized || !stream) return false;
-            
-            //stop(trackNum);
-            stream->seek(44);
-            
-            tracks[trackNum] = {
-                .stream = stream,
-                .isPlaying = true,
-                .isPaused = false,
-                .volume = tracks[trackNum].volume,
-                .fadeVolume = 0,
-                .buffer = tracks[trackNum].buffer,
-                .bufferPos = mixBufferSize, // Force buffer refill
-                .loop = false
-            };
+            if (!canStart(trackNum) || !stream) return false;
+            AudioSource* source = openDecoder(tracks[trackNum], stream);
+            if (!source) return false;
+            return startTrack(trackNum, source, false);
+        }
+
+#ifndef ASYNC_AUDIO_NO_RAW
+        // Headerless mono 16-bit PCM, described by the caller
+        bool play(int trackNum, Stream* stream, const RawFormat& format) {
+            if (!canStart(trackNum) || !stream) return false;
+            DecoderSlot* slot = freeDecoder(tracks[trackNum]);
+            if (!slot || !slot->open(stream, format)) return false;
+            return startTrack(trackNum, slot->get(), false);
+        }
+#endif
+        
+        bool play(int trackNum, AudioSource* source) {
+            if (!canStart(trackNum) || !source) return false;
+            return startTrack(trackNum, source, false);
+        }
+
+        // Compile-time described asset (see WAV_ASSET), played straight from memory
+        bool play(int trackNum, const WavAsset& asset) {
+            if (!canStart(trackNum) || !asset.playable()) return false;
+            tracks[trackNum].pcm.open(asset);
+            return startTrack(trackNum, &tracks[trackNum].pcm, false);
+        }
+
+        // Loops between the file's smpl/cue loop points (the whole data if it
+        // has none), optionally crossfading the seam over crossfadeMs.
+        // Other formats loop the whole stream and ignore crossfadeMs.
+        bool loop(int trackNum, Stream* stream, float crossfadeMs = 0.0f) {
+            if (!canStart(trackNum) || !stream) return false;
+            DecoderSlot* slot = freeDecoder(tracks[trackNum]);
+            if (!slot || !slot->open(stream, sampleRate)) return false;
+#ifndef ASYNC_AUDIO_NO_WAV
+            if (slot->getFormat() == FORMAT_WAV) {
+                static_cast<WavSource*>(slot->get())->setLoopCrossfade((size_t)(max(crossfadeMs, 0.0f) * sampleRate / 1000.0f));
+            }
+#endif
+            return startTrack(trackNum, slot->get(), true);
+        }
+        
+        bool loop(int trackNum, AudioSource* source) {
+            if (!canStart(trackNum) || !source) return false;
+            return startTrack(trackNum, source, true);
+        }
+
+        bool loop(int trackNum, const WavAsset& asset) {
+            if (!canStart(trackNum) || !asset.playable()) return false;
+            tracks[trackNum].pcm.open(asset);
+            return startTrack(trackNum, &tracks[trackNum].pcm, true);
+        }
+        
+        // Plays a one-shot of asset on a free voice, stealing the oldest when
+        // all MAX_VOICES are busy. Any number of voices share the asset's
+        // samples; starting one allocates and copies nothing. Returns the
+        // voice for stopVoice(), or -1.
+        int trigger(const WavAsset& asset, float volume = 1.0f, int bus = 0) {
+            if (!initialized || !asset.playable() || !isValidBus(bus)) return -1;
+            return startVoice(asset, (int32_t)(constrain(volume, 0.0f, 1.0f) * UNITY_GAIN), bus);
+        }
+        
+        // trigger() for interrupt handlers: only posts the request to a
+        // wait-free ring, which is drained at the next block boundary (or,
+        // with setExpressChunk, before the next chunk of the current block
+        // goes out). Integer volume 0-255 keeps the FPU out of the ISR. One
+        // producer: a single ISR, or several that can't preempt each other.
+        // asset must stay valid until it plays (WAV_ASSET data does).
+        // The output DMA queue still sits between the mix and the speaker:
+        // the default 8 x 1024 frames is about 256 ms at 32 kHz, so low
+        // trigger-to-output latency also needs setOutputLatency.
+        bool IRAM_ATTR triggerFromISR(const WavAsset& asset, uint8_t volume = 255, uint8_t bus = 0) {
+            uint8_t head = triggerHead;
+            uint8_t next = (head + 1) % TRIGGER_RING_SIZE;
+            if (next == triggerTail) return false;
+            triggerRing[head].asset = &asset;
+            triggerRing[head].volume = volume;
+            triggerRing[head].bus = bus;
+            __sync_synchronize();
+            triggerHead = next;
+            return true;
+        }
+        
+        // Output DMA queue, applied by the next start(). Latency from a
+        // finished block to the speaker is up to ms; the default queues
+        // 8 x 1024 frames. Shorter queues underrun sooner if tick() is late.
+        void setOutputLatency(float ms) {
+            size_t frames = (size_t)(max(ms, 1.0f) * sampleRate / 1000.0f);
+            dmaBufLen = constrain((int)frames / 2, 8, 1024);
+            dmaBufCount = constrain((int)((frames + dmaBufLen - 1) / dmaBufLen), 2, 128);
+        }
+        
+        // Output used by the next start(). The built-in DAC only exists on
+        // the original ESP32; elsewhere it is refused.
+        bool setOutput(WavPlayerOutput output) {
+#if !SOC_I2S_SUPPORTS_DAC
+            if (output == OUTPUT_BUILTIN_DAC) return false;
+#endif
+            outputMode = output;
+            return true;
+        }
+        
+        // Built-in DAC: TPDF dither with first-order noise shaping (default),
+        // or plain rounding to 8 bits
+        void setNoiseShaping(bool enable) {
+            dither.noiseShaping = enable;
+            dither.reset();
+        }
+        
+        // Hands each block to the output in chunks of frames and starts ISR
+        // triggers between them, mixed into the part not yet written, so a
+        // key click waits for a chunk rather than a whole block. 0 writes
+        // whole blocks. Has no effect while the limiter is enabled, since
+        // injected voices would bypass it. This only shortens the wait for
+        // the mix; the DMA queue behind it is set by setOutputLatency (a
+        // few ms, e.g. setOutputLatency(4), for trigger-to-output under
+        // 5 ms at the cost of underruns if tick() runs late).
+        void setExpressChunk(size_t frames) {
+            expressChunk = min(frames, mixBufferSize);
+        }
+        
+        void stopVoice(int voice) {
+            if (voice >= 0 && voice < MAX_VOICES) voices[voice].active = false;
+        }
+        
+        void stopVoices() {
+            for (int i = 0; i < MAX_VOICES; i++) voices[i].active = false;
+            for (int i = 0; i < FADING_VOICES; i++) fadingVoices[i].active = false;
+        }
+        
+        int getActiveVoices() const {
+            int count = 0;
+            for (int i = 0; i < MAX_VOICES; i++) {
+                if (voices[i].active) count++;
+            }
+            return count;
+        }
+        
+        // Queues a source to follow the current one on the same track without
+        // a gap (or crossfaded, see setCrossfade). Starts it if the track is idle;
+        // a looping track finishes its current pass and then moves on.
+        bool enqueue(int trackNum, Stream* stream) {
+            if (!canStart(trackNum) || !stream) return false;
+            if (!tracks[trackNum].isPlaying) return play(trackNum, stream);
             
-            if (eventCallback) eventCallback(trackNum, TRACK_STARTED);
+            QueuedSource* slot = queueSlot(tracks[trackNum]);
+            if (!slot) return false;
+            slot->source = openDecoder(tracks[trackNum], stream);
+            if (!slot->source) return false;
+            tracks[trackNum].queueCount++;
+            endLoop(tracks[trackNum]);
             return true;
         }
-
-        bool loop(int trackNum, Stream* stream) {
-            if (trackNum < 0 || trackNum >= MAX_TRACKS || !initialized || !stream) return false;
-            
-            //stop(trackNum);
-            stream->seek(44);
-            
-            tracks[trackNum] = {
-                .stream = stream,
-                .isPlaying = true,
-                .isPaused = false,
-                .volume = tracks[trackNum].volume,
-                .fadeVolume = 0,
-                .buffer = tracks[trackNum].buffer,
-                .bufferPos = mixBufferSize, // Force buffer refill
-                .loop = true
-            };
+        
+        bool enqueue(int trackNum, AudioSource* source) {
+            if (!canStart(trackNum) || !source) return false;
+            if (!tracks[trackNum].isPlaying) return play(trackNum, source);
             
-            if (eventCallback) eventCallback(trackNum, TRACK_STARTED);
+            QueuedSource* slot = queueSlot(tracks[trackNum]);
+            if (!slot) return false;
+            slot->source = source;
+            tracks[trackNum].queueCount++;
+            endLoop(tracks[trackNum]);
             return true;
         }
         
+        // Equal-power crossfade into queued sources of known length; 0 means gapless
+        void setCrossfade(int trackNum, float ms) {
+            if (trackNum < 0 || trackNum >= MAX_TRACKS) return;
+            size_t frames = (size_t)(max(ms, 0.0f) * sampleRate / 1000.0f);
+            tracks[trackNum].crossfadeFrames = min(frames, (size_t)MAX_CROSSFADE);
+        }
+        
+        uint32_t getSampleRate() const {
+            return sampleRate;
+        }
+        
+        // Events are queued with the output sample they belong to and handed
+        // to the callback by tick() once the block is with the output, so a
+        // slow callback never delays the mix. Calling play() and friends from
+        // the callback is fine.
         void onEvent(WavPlayerCallback callback) {
             eventCallback = callback;
         }
         
+        // Output sample (frames since start(), wrapping) of the event being
+        // dispatched: for events raised while mixing, the first sample of that block
+        uint32_t getEventSample() const {
+            return eventSample;
+        }
+        
+        uint32_t getOutputFrames() const {
+            return outputFrames;
+        }
+        
+        // Events lost because more than EVENT_RING_SIZE piled up between ticks
+        uint32_t getDroppedEvents() const {
+            return droppedEvents;
+        }
+        
         void pause(int trackNum) {
             if (!isValidTrack(trackNum) || tracks[trackNum].isPaused) return;
             tracks[trackNum].isPaused = true;
-            if (eventCallback) eventCallback(trackNum, TRACK_PAUSED);
+            postEvent(trackNum, TRACK_PAUSED);
         }
         
         void resume(int trackNum) {
             if (!isValidTrack(trackNum) || !tracks[trackNum].isPaused) return;
             tracks[trackNum].isPaused = false;
-            if (eventCallback) eventCallback(trackNum, TRACK_RESUMED);
+            postEvent(trackNum, TRACK_RESUMED);
         }
         
         void stop(int trackNum) {
             if (!isValidTrack(trackNum)) return;
             
+            releaseSources(tracks[trackNum], nullptr);
             tracks[trackNum].isPlaying = false;
             tracks[trackNum].isPaused = false;
+            tracks[trackNum].queueCount = 0;
+            tracks[trackNum].fadeLength = 0;
+            tracks[trackNum].source = nullptr;
+            releaseDecoders(tracks[trackNum]);
             
-            if (eventCallback) eventCallback(trackNum, TRACK_STOPPED);
+            postEvent(trackNum, TRACK_STOPPED);
         }
         
         bool isPlaying(int trackNum) const {
             return isValidTrack(trackNum) && tracks[trackNum].isPlaying && !tracks[trackNum].isPaused;
         }
         
+        // Decode cost of the track's current source, for sources that decode
+        bool getDecodeStats(int trackNum, DecodeStats& stats) const {
+            if (!isValidTrack(trackNum) || !tracks[trackNum].source) return false;
+            return tracks[trackNum].source->getDecodeStats(stats);
+        }
+        
         bool isPaused(int trackNum) const {
             return isValidTrack(trackNum) && tracks[trackNum].isPlaying && tracks[trackNum].isPaused;
         }
@@ -210,65 +576,860 @@ namespace async {
             return isValidTrack(trackNum) ? tracks[trackNum].volume : 0.0f;
         }
         
+        // Routes a track to a mix bus. Tracks start on bus 0.
+        void setBus(int trackNum, int bus) {
+            if (trackNum >= 0 && trackNum < MAX_TRACKS && isValidBus(bus)) {
+                tracks[trackNum].bus = bus;
+            }
+        }
+        
+        int getBus(int trackNum) const {
+            return trackNum >= 0 && trackNum < MAX_TRACKS ? tracks[trackNum].bus : -1;
+        }
+        
+        void setBusVolume(int bus, float volume) {
+            if (isValidBus(bus)) {
+                buses[bus].volume = constrain(volume, 0.0f, 1.0f);
+            }
+        }
+        
+        float getBusVolume(int bus) const {
+            return isValidBus(bus) ? buses[bus].volume : 0.0f;
+        }
+        
+        // Muted buses keep their tracks advancing, they are just not summed
+        void setBusMute(int bus, bool muted) {
+            if (isValidBus(bus)) {
+                buses[bus].muted = muted;
+            }
+        }
+        
+        bool isBusMuted(int bus) const {
+            return isValidBus(bus) && buses[bus].muted;
+        }
+        
+        // Buses without an effect are folded into the track gains and cost
+        // nothing extra; an effect gives the bus its own accumulator. Effects
+        // with a tail keep the bus running while active() says so.
+        bool setBusEffect(int bus, AudioEffect* effect) {
+            if (!isValidBus(bus)) return false;
+            
+            if (effect && !buses[bus].accum) {
+                buses[bus].accum = (int32_t*)malloc(mixBufferSize * sizeof(int32_t));
+                if (!buses[bus].accum) return false;
+            }
+            
+            buses[bus].effect = effect;
+            return true;
+        }
+        
+        // Lowers the buses in targetBusMask to depth while trackNum is above
+        // threshold. Threshold and depth are fractions of full scale.
+        void setDuckingFromTrack(int trackNum, uint8_t targetBusMask, float threshold = 0.02f, float depth = 0.3f,
+                                 float attackMs = 20.0f, float releaseMs = 300.0f) {
+            if (trackNum < 0 || trackNum >= MAX_TRACKS) return;
+            configureDucker(trackNum, -1, targetBusMask, threshold, depth, attackMs, releaseMs);
+        }
+        
+        void setDuckingFromBus(int bus, uint8_t targetBusMask, float threshold = 0.02f, float depth = 0.3f,
+                               float attackMs = 20.0f, float releaseMs = 300.0f) {
+            if (!isValidBus(bus)) return;
+            configureDucker(-1, bus, targetBusMask, threshold, depth, attackMs, releaseMs);
+        }
+        
+        void disableDucking() {
+            ducker.enabled = false;
+            ducker.envelope = 0;
+            ducker.gain = UNITY_GAIN;
+            ducker.prevGain = UNITY_GAIN;
+        }
+        
+        // Enables the master bus limiter. Threshold is a fraction of full scale,
+        // lookahead is capped at Limiter::MAX_LOOKAHEAD samples.
+        void setLimiter(float threshold, float attackMs = 1.0f, float releaseMs = 50.0f, float lookaheadMs = 1.0f) {
+            limiter.configure(sampleRate, threshold, attackMs, releaseMs, lookaheadMs);
+            limiterEnabled = true;
+        }
+        
+        void disableLimiter() {
+            limiterEnabled = false;
+        }
+        
         bool tick() {
             if (!initialized) return false;
             
-            memset(mixBuffer, 0, mixBufferSize * sizeof(int16_t));
-            bool anyActive = false;
-            
+            while (takeTrigger() >= 0) {}
+            renderBlock();
+            dispatchEvents();
+            return true;
+        }
+
+    private:
+        void renderBlock() {
             for (int i = 0; i < MAX_TRACKS; i++) {
+                tracks[i].bufferLen = 0;
+                tracks[i].silent = false;
                 if (tracks[i].isPlaying && !tracks[i].isPaused) {
-                    if (mixTrack(i)) {
-                        anyActive = true;
+                    fillTrack(i);
+                }
+            }
+            
+            // Count after filling: tracks may have ended
+            int activeCount = 0;
+            int lastActive = -1;
+            bool silentTrack = false;
+            for (int i = 0; i < MAX_TRACKS; i++) {
+                if (isAudible(i)) {
+                    activeCount++;
+                    lastActive = i;
+                } else if (isMixable(i)) {
+                    // Skipped silence or a muted bus: still playing, so still paced
+                    silentTrack = true;
+                }
+            }
+            
+            if (ducker.enabled) updateDucker();
+            bool voicesActive = getActiveVoices() > 0 || voicesFading();
+            bool tails = effectTails();
+            
+            if (activeCount == 0 && !voicesActive && !tails) {
+                advanceFades();
+                if (!silentTrack) {
+                    // Nothing to play: the output drains on purpose, once the
+                    // limiter has let out the end of the sound it still delays
+                    if (limiterEnabled && limiter.holding()) {
+                        memset(mixAccum, 0, mixBufferSize * sizeof(int32_t));
+                        limiter.process(mixAccum, mixBuffer, mixBufferSize);
+                        writeOutput(mixBuffer);
                     }
+                    if (limiterEnabled) limiter.reset();
+                    outputRunning = false;
+                    return;
                 }
+                
+                // Only skipped silence or muted buses: keep real time with a zero block
+                if (limiterEnabled) {
+                    memset(mixAccum, 0, mixBufferSize * sizeof(int32_t));
+                    limiter.process(mixAccum, mixBuffer, mixBufferSize);
+                } else {
+                    memset(mixBuffer, 0, mixBufferSize * sizeof(int16_t));
+                }
+                writeOutput(mixBuffer);
+                return;
             }
             
-            if (anyActive) {
-                size_t bytesWritten;
-                i2s_write(I2S_NUM_0, mixBuffer, mixBufferSize * sizeof(int16_t), &bytesWritten, portMAX_DELAY);
+            if (activeCount == 1 && !voicesActive && !tails && !limiterEnabled && !buses[tracks[lastActive].bus].effect
+                && directGain(tracks[lastActive]) == UNITY_GAIN && !isDucked(tracks[lastActive].bus)) {
+                // Single track at unity gain: hand its samples straight to the output
+                AudioTrack& track = tracks[lastActive];
+                if (track.bufferLen < mixBufferSize) {
+                    memset(track.buffer + track.bufferLen, 0, (mixBufferSize - track.bufferLen) * sizeof(int16_t));
+                }
+                writeOutput(track.buffer);
+                advanceFades();
+                return;
             }
             
-            return true;
+            // First track writes the accumulator, the rest add into it.
+            // Plain buses fold their gain into the track gain.
+            bool first = true;
+            for (int i = 0; i < MAX_TRACKS; i++) {
+                if (isAudible(i) && !buses[tracks[i].bus].effect) {
+                    int32_t gain = directGain(tracks[i]);
+                    mixSamples(mixAccum, tracks[i].buffer, tracks[i].bufferLen,
+                        duck(gain, tracks[i].bus, true), duck(gain, tracks[i].bus, false), first);
+                    first = false;
+                }
+            }
+            if (voicesActive) first = mixVoices(mixAccum, -1, first);
+            
+            for (int b = 0; b < MAX_BUSES; b++) {
+                MixBus& bus = buses[b];
+                if (!bus.effect || bus.muted) continue;
+                
+                bool busFirst = true;
+                for (int i = 0; i < MAX_TRACKS; i++) {
+                    if (isAudible(i) && tracks[i].bus == b) {
+                        int32_t gain = trackGain(tracks[i]);
+                        mixSamples(bus.accum, tracks[i].buffer, tracks[i].bufferLen, gain, gain, busFirst);
+                        busFirst = false;
+                    }
+                }
+                if (voicesActive) busFirst = mixVoices(bus.accum, b, busFirst);
+                if (busFirst) {
+                    // No input: only run the effect to play out its tail
+                    if (!bus.effect->active()) continue;
+                    memset(bus.accum, 0, mixBufferSize * sizeof(int32_t));
+                }
+                
+                bus.effect->process(bus.accum, mixBufferSize);
+                int32_t gain = busGain(bus);
+                mixBus(bus, duck(gain, b, true), duck(gain, b, false), first);
+                first = false;
+            }
+            
+            advanceFades();
+            
+            // Every voice ended this block and nothing else played
+            if (first) memset(mixAccum, 0, mixBufferSize * sizeof(int32_t));
+            
+            if (limiterEnabled) {
+                limiter.process(mixAccum, mixBuffer, mixBufferSize);
+            } else {
+                for (size_t i = 0; i < mixBufferSize; i++) {
+                    mixBuffer[i] = saturate16(mixAccum[i]);
+                }
+            }
+            
+            writeOutput(mixBuffer);
+        }
+
+        static const int32_t UNITY_GAIN = 1 << 15;
+        static const size_t MAX_CROSSFADE = 65535;
+
+        // Undoes start(): track buffers, the DAC mode and the driver
+        void releaseOutput() {
+            for (int i = 0; i < MAX_TRACKS; i++) {
+                free(tracks[i].buffer);
+                tracks[i].buffer = nullptr;
+            }
+#if SOC_I2S_SUPPORTS_DAC
+            if (dacBuffer) i2s_set_dac_mode(I2S_DAC_CHANNEL_DISABLE);
+#endif
+            free(dacBuffer);
+            dacBuffer = nullptr;
+            i2s_driver_uninstall(I2S_NUM_0);
+        }
+
+        // Some unmuted bus effect still has a tail to play out
+        bool effectTails() const {
+            for (int b = 0; b < MAX_BUSES; b++) {
+                if (buses[b].effect && !buses[b].muted && buses[b].effect->active()) return true;
+            }
+            return false;
+        }
+
+        int startVoice(const WavAsset& asset, int32_t gain, int bus) {
+            int chosen = 0;
+            for (int i = 0; i < MAX_VOICES; i++) {
+                if (!voices[i].active) {
+                    chosen = i;
+                    break;
+                }
+                if ((int32_t)(voices[i].serial - voices[chosen].serial) < 0) chosen = i;
+            }
+            
+            Voice& voice = voices[chosen];
+            if (voice.active) fadeOut(voice);
+            voice.cursor.open(asset);
+            voice.gain = gain;
+            voice.bus = bus;
+            voice.serial = ++voiceSerial;
+            voice.active = true;
+            return chosen;
+        }
+        
+        // Next ISR request as a started voice, -1 when the ring is empty
+        int takeTrigger() {
+            while (triggerTail != triggerHead) {
+                __sync_synchronize();
+                TriggerRequest request = triggerRing[triggerTail];
+                __sync_synchronize();
+                triggerTail = (triggerTail + 1) % TRIGGER_RING_SIZE;
+                if (!request.asset || !request.asset->playable() || !isValidBus(request.bus)) continue;
+                return startVoice(*request.asset, ((int32_t)request.volume * UNITY_GAIN) / 255, request.bus);
+            }
+            return -1;
+        }
+        
+        // Mixes a voice just started from the ISR ring into the unsent tail
+        // of the current output block, which has already been through the
+        // master stage, so writeOutput only calls this with the limiter off.
+        // Voices on effect buses join from the next block, as the effect
+        // already ran.
+        void injectVoice(int index, int16_t* samples, size_t count) {
+            Voice& voice = voices[index];
+            const MixBus& bus = buses[voice.bus];
+            if (bus.effect || bus.muted) return;
+            
+            size_t got = voice.cursor.read(scratchBuffer, count);
+            if (got == 0) {
+                voice.active = false;
+                return;
+            }
+            int32_t gain = voice.gain;
+            int32_t level = duck(busGain(bus), voice.bus, false);
+            if (level != UNITY_GAIN) gain = (gain * level) >> 15;
+            for (size_t i = 0; i < got; i++) {
+                samples[i] = saturate16(samples[i] + ((scratchBuffer[i] * gain) >> 15));
+            }
         }
 
-    private:
         bool isValidTrack(int trackNum) const {
             return trackNum >= 0 && trackNum < MAX_TRACKS && initialized;
         }
         
-        bool mixTrack(int trackNum) {
+        bool canStart(int trackNum) const {
+            return trackNum >= 0 && trackNum < MAX_TRACKS && initialized;
+        }
+        
+        bool startTrack(int trackNum, AudioSource* source, bool loop) {
             AudioTrack& track = tracks[trackNum];
+            releaseSources(track, source);
+            track.source = source;
+            track.isPlaying = true;
+            track.isPaused = false;
+            track.fadeVolume = 0;
+            track.bufferLen = 0;
+            track.loop = loop;
+            track.queueCount = 0;
+            track.fadeLength = 0;
+            track.underruns = decodeUnderruns(source);
+            releaseDecoders(track);
+            source->setLooping(loop);
             
-            // Refill buffer if empty
-            if (track.bufferPos >= mixBufferSize) {
-                size_t samplesToRead = mixBufferSize;
+            postEvent(trackNum, TRACK_STARTED);
+            return true;
+        }
+        
+        static void endLoop(AudioTrack& track) {
+            if (!track.loop) return;
+            track.loop = false;
+            track.source->setLooping(false);
+        }
+        
+        // Lets go of the current and queued sources, except keep
+        static void releaseSources(AudioTrack& track, AudioSource* keep) {
+            if (track.isPlaying && track.source && track.source != keep) track.source->release();
+            for (int i = 0; i < track.queueCount; i++) {
+                AudioSource* queued = track.queue[(track.queueHead + i) % QUEUE_SIZE].source;
+                if (queued != keep) queued->release();
+            }
+        }
+        
+        static bool decoderInUse(const AudioTrack& track, const DecoderSlot& slot) {
+            AudioSource* source = slot.get();
+            if (!source) return false;
+            if (source == track.source) return true;
+            for (int i = 0; i < track.queueCount; i++) {
+                if (track.queue[(track.queueHead + i) % QUEUE_SIZE].source == source) return true;
+            }
+            return false;
+        }
+
+        DecoderSlot* freeDecoder(AudioTrack& track) {
+            for (int i = 0; i < DECODER_SLOTS; i++) {
+                if (!decoderInUse(track, track.decoders[i])) return &track.decoders[i];
+            }
+            return nullptr;
+        }
+
+        AudioSource* openDecoder(AudioTrack& track, Stream* stream) {
+            DecoderSlot* slot = freeDecoder(track);
+            return slot ? slot->open(stream, sampleRate) : nullptr;
+        }
+
+        // Closes decoders the track no longer plays or queues (MP3 returns its buffers)
+        static void releaseDecoders(AudioTrack& track) {
+            for (int i = 0; i < DECODER_SLOTS; i++) {
+                if (!decoderInUse(track, track.decoders[i])) track.decoders[i].release();
+            }
+        }
+        
+        QueuedSource* queueSlot(AudioTrack& track) {
+            if (track.queueCount >= QUEUE_SIZE) return nullptr;
+            return &track.queue[(track.queueHead + track.queueCount) % QUEUE_SIZE];
+        }
+        
+        AudioSource* nextSource(const AudioTrack& track) const {
+            return track.queueCount > 0 ? track.queue[track.queueHead].source : nullptr;
+        }
+        
+        // Makes the head of the queue the current source
+        void advanceQueue(int trackNum) {
+            AudioTrack& track = tracks[trackNum];
+            AudioSource* previous = track.source;
+            track.source = track.queue[track.queueHead].source;
+            if (previous && previous != track.source) previous->release();
+            track.queueHead = (track.queueHead + 1) % QUEUE_SIZE;
+            track.queueCount--;
+            releaseDecoders(track);
+            track.fadeLength = 0;
+            track.loop = false;
+            track.source->setLooping(false);
+            track.underruns = decodeUnderruns(track.source);
+            
+            postEvent(trackNum, TRACK_STARTED);
+        }
+        
+        static uint32_t decodeUnderruns(const AudioSource* source) {
+            DecodeStats stats;
+            return source->getDecodeStats(stats) ? stats.underruns : 0;
+        }
+        
+        void postEvent(int trackNum, WavPlayerEvent event, size_t offset = 0) {
+            if (eventCount >= EVENT_RING_SIZE) {
+                droppedEvents++;
+                return;
+            }
+            PendingEvent& pending = events[(eventHead + eventCount) % EVENT_RING_SIZE];
+            pending.trackNum = trackNum;
+            pending.event = event;
+            pending.sample = outputFrames + offset;
+            eventCount++;
+        }
+        
+        // Only what was queued on entry: events raised by the callbacks
+        // themselves wait for the next tick
+        void dispatchEvents() {
+            uint8_t count = eventCount;
+            while (count-- > 0 && eventCount > 0) {
+                PendingEvent pending = events[eventHead];
+                eventHead = (eventHead + 1) % EVENT_RING_SIZE;
+                eventCount--;
+                if (!eventCallback) continue;
+                eventSample = pending.sample;
+                eventCallback(pending.trackNum, (WavPlayerEvent)pending.event);
+            }
+        }
+        
+        // Compares frames handed to the output with the time passed since
+        // the output clock was anchored (see syncOutput). Runs before each
+        // block is written.
+        void checkOutput() {
+            uint32_t now = micros();
+            if (!outputRunning) {
+                outputRunning = true;
+                outputLow = false;
+                anchorMicros = now;
+                anchorFrames = outputFrames;
+                return;
+            }
+            
+            uint32_t elapsed = now - anchorMicros;
+            uint32_t played = (uint32_t)((uint64_t)elapsed * sampleRate / 1000000);
+            int32_t queued = (int32_t)(outputFrames - anchorFrames - played);
+            
+            if (queued <= 0) {
+                postEvent(-1, OUTPUT_UNDERRUN);
+                anchorMicros = now;
+                anchorFrames = outputFrames;
+                outputLow = false;
+                return;
+            }
+            
+            bool low = queued < (int32_t)mixBufferSize;
+            if (low && !outputLow) postEvent(-1, OUTPUT_BUFFER_LOW);
+            outputLow = low;
+            
+            // Re-anchor now and then so micros() wrapping can't skew the clock
+            if (elapsed > 10000000UL) {
+                anchorMicros = now;
+                anchorFrames = outputFrames - queued;
+            }
+        }
+        
+        // A write that had to wait for the DMA left its queue exactly full,
+        // so the clock re-anchors to that instead of carrying the micros()
+        // estimate forward. written counts the frames of this block so far.
+        void syncOutput(size_t written) {
+            anchorMicros = micros();
+            anchorFrames = outputFrames + written - (uint32_t)(dmaBufCount * dmaBufLen);
+        }
+        
+        // Quarter sine in Q15 for x in [0, 65536]
+        static int32_t equalPower(uint32_t x) {
+            static const int16_t table[65] = {
+                0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512,
+                10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530, 18204, 18868,
+                19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279, 24811, 25329, 25832, 26319,
+                26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956, 30273, 30571, 30852, 31113,
+                31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757, 32767
+            };
+            if (x >= 65536) return table[64];
+            uint32_t index = x >> 10;
+            int32_t frac = x & 1023;
+            return table[index] + (((table[index + 1] - table[index]) * frac) >> 10);
+        }
+        
+        // Blends the tail of the current source with the head of the next one
+        size_t crossfade(AudioTrack& track, int16_t* out, size_t frames) {
+            frames = min(frames, track.fadeLength - track.fadePos);
+            
+            size_t got = track.source->read(out, frames);
+            if (got < frames) memset(out + got, 0, (frames - got) * sizeof(int16_t));
+            got = nextSource(track)->read(scratchBuffer, frames);
+            if (got < frames) memset(scratchBuffer + got, 0, (frames - got) * sizeof(int16_t));
+            
+            for (size_t i = 0; i < frames; i++) {
+                uint32_t x = ((track.fadePos + i) << 16) / track.fadeLength;
+                int32_t in = equalPower(x);
+                int32_t outGain = equalPower(65536 - x);
+                out[i] = saturate16((out[i] * outGain + scratchBuffer[i] * in) >> 15);
+            }
+            
+            track.fadePos += frames;
+            return frames;
+        }
+        
+        bool isValidBus(int bus) const {
+            return bus >= 0 && bus < MAX_BUSES;
+        }
+        
+        bool isMixable(int trackNum) const {
+            const AudioTrack& track = tracks[trackNum];
+            return track.isPlaying && !track.isPaused && track.bufferLen > 0;
+        }
+        
+        // Silent blocks were skipped, not read, so they are left out of the mix
+        bool isAudible(int trackNum) const {
+            return isMixable(trackNum) && !tracks[trackNum].silent && !buses[tracks[trackNum].bus].muted;
+        }
+        
+        static int16_t saturate16(int32_t sample) {
+            if (sample > INT16_MAX) return INT16_MAX;
+            if (sample < INT16_MIN) return INT16_MIN;
+            return (int16_t)sample;
+        }
+        
+        // Q15 gain for the current block
+        static int32_t trackGain(const AudioTrack& track) {
+            return (int32_t)(track.fadeVolume * UNITY_GAIN);
+        }
+        
+        static int32_t busGain(const MixBus& bus) {
+            return (int32_t)(bus.volume * UNITY_GAIN);
+        }
+        
+        // Track gain with its bus volume folded in, for buses without an effect
+        int32_t directGain(const AudioTrack& track) const {
+            int32_t gain = trackGain(track);
+            int32_t level = busGain(buses[track.bus]);
+            return level == UNITY_GAIN ? gain : (gain * level) >> 15;
+        }
+        
+        bool isDucked(int bus) const {
+            return ducker.enabled && (ducker.targetBuses & (1 << bus))
+                && (ducker.gain != UNITY_GAIN || ducker.prevGain != UNITY_GAIN);
+        }
+        
+        // Applies the duck gain at the start (previous) or end of the block
+        int32_t duck(int32_t gain, int bus, bool previous) const {
+            if (!isDucked(bus)) return gain;
+            return (gain * (previous ? ducker.prevGain : ducker.gain)) >> 15;
+        }
+        
+        int32_t blockCoefficient(float ms) const {
+            float blocks = ms * sampleRate / 1000.0f / mixBufferSize;
+            if (blocks < 1.0f) return UNITY_GAIN;
+            return (int32_t)((1.0f - expf(-1.0f / blocks)) * UNITY_GAIN);
+        }
+        
+        void configureDucker(int sourceTrack, int sourceBus, uint8_t targetBusMask, float threshold, float depth,
+                             float attackMs, float releaseMs) {
+            ducker.sourceTrack = sourceTrack;
+            ducker.sourceBus = sourceBus;
+            ducker.targetBuses = targetBusMask;
+            ducker.threshold = (int32_t)(constrain(threshold, 0.0f, 1.0f) * INT16_MAX);
+            ducker.depth = (int32_t)(constrain(depth, 0.0f, 1.0f) * UNITY_GAIN);
+            ducker.attackCoef = blockCoefficient(attackMs);
+            ducker.releaseCoef = blockCoefficient(releaseMs);
+            ducker.envelope = 0;
+            ducker.gain = UNITY_GAIN;
+            ducker.prevGain = UNITY_GAIN;
+            ducker.enabled = true;
+        }
+        
+        // Peak of the track's current block after its own gain
+        int32_t blockPeak(const AudioTrack& track) const {
+            if (track.silent) return 0;
+            int32_t peak = 0;
+            for (size_t i = 0; i < track.bufferLen; i++) {
+                int32_t sample = track.buffer[i];
+                if (sample < 0) sample = -sample;
+                if (sample > peak) peak = sample;
+            }
+            return (peak * trackGain(track)) >> 15;
+        }
+        
+        void updateDucker() {
+            ducker.prevGain = ducker.gain;
+            
+            int32_t peak = 0;
+            bool sourceActive = false;
+            for (int i = 0; i < MAX_TRACKS; i++) {
+                if (!isMixable(i)) continue;
+                if (i == ducker.sourceTrack || tracks[i].bus == ducker.sourceBus) {
+                    sourceActive = true;
+                    peak = max(peak, blockPeak(tracks[i]));
+                }
+            }
+            
+            // Idle and fully released: nothing to do until the source plays again
+            if (!sourceActive && ducker.envelope == 0 && ducker.gain == UNITY_GAIN) return;
+            
+            if (peak > ducker.envelope) {
+                ducker.envelope += ((peak - ducker.envelope) * ducker.attackCoef >> 15) + 1;
+            } else {
+                ducker.envelope -= ((ducker.envelope - peak) * ducker.releaseCoef >> 15) + 1;
+                if (ducker.envelope < peak) ducker.envelope = peak;
+                if (ducker.envelope < ducker.threshold / 4) ducker.envelope = 0;
+            }
+            
+            int32_t target = ducker.envelope > ducker.threshold ? ducker.depth : UNITY_GAIN;
+            int32_t coef = target < ducker.gain ? ducker.attackCoef : ducker.releaseCoef;
+            ducker.gain += ((target - ducker.gain) * coef) >> 15;
+            if (abs(target - ducker.gain) < 64) ducker.gain = target;
+        }
+        
+        void advanceFades() {
+            for (int i = 0; i < MAX_TRACKS; i++) {
+                if (isMixable(i)) advanceFade(tracks[i]);
+            }
+        }
+        
+        static void advanceFade(AudioTrack& track) {
+            if (track.fadeVolume < track.volume) {
+                track.fadeVolume = min(track.fadeVolume + 0.1f, track.volume);
+            } else {
+                track.fadeVolume = track.volume;
+            }
+        }
+        
+        // i2s_write returns once the block is queued for DMA; decoders fill
+        // their buffers in the time that buys before the next block is due
+        void writeOutput(int16_t* samples) {
+            checkOutput();
+            
+            // Injected voices would skip the limiter, so with it enabled ISR
+            // triggers wait for the next block like any other
+            if (expressChunk == 0 || expressChunk >= mixBufferSize || limiterEnabled) {
+                if (writeSamples(samples, mixBufferSize)) syncOutput(mixBufferSize);
+            } else {
+                for (size_t offset = 0; offset < mixBufferSize; offset += expressChunk) {
+                    if (offset > 0) {
+                        int voice;
+                        while ((voice = takeTrigger()) >= 0) injectVoice(voice, samples + offset, mixBufferSize - offset);
+                    }
+                    size_t count = min(expressChunk, mixBufferSize - offset);
+                    if (writeSamples(samples + offset, count)) syncOutput(offset + count);
+                }
+            }
+            
+            for (int i = 0; i < MAX_TRACKS; i++) {
+                if (tracks[i].isPlaying && !tracks[i].isPaused) tracks[i].source->prefetch();
+            }
+            outputFrames += mixBufferSize;
+        }
+        
+        // True if the write had to wait for room in the DMA queue
+        bool writeSamples(const int16_t* samples, size_t count) {
+            if (dacBuffer) {
+                packDac(samples, dacBuffer, count, dither);
+                return writeDma(dacBuffer, count * 2 * sizeof(uint16_t));
+            }
+            return writeDma(samples, count * sizeof(int16_t));
+        }
+        
+        bool writeDma(const void* data, size_t bytes) {
+            size_t bytesWritten = 0;
+            i2s_write(I2S_NUM_0, data, bytes, &bytesWritten, 0);
+            if (bytesWritten >= bytes) return false;
+            size_t rest;
+            i2s_write(I2S_NUM_0, (const uint8_t*)data + bytesWritten, bytes - bytesWritten, &rest, portMAX_DELAY);
+            return true;
+        }
+        
+        void fillTrack(int trackNum) {
+            AudioTrack& track = tracks[trackNum];
+            size_t filled = 0;
+            bool rewound = false;
+            AudioSource* looping = track.loop ? track.source : nullptr;
+            uint32_t wraps = looping ? looping->getLoopCount() : 0;
+            
+            // A whole block of known silence is skipped without touching sample memory.
+            // Not while a crossfade into the next source may start inside it.
+            if (track.fadeLength == 0 && !(nextSource(track) && track.crossfadeFrames > 0)
+                && track.source->silentFrames() >= mixBufferSize) {
+                track.bufferLen = track.source->skip(mixBufferSize);
+                track.silent = track.bufferLen > 0;
+                return;
+            }
+            
+            while (filled < mixBufferSize && track.isPlaying) {
+                int16_t* out = track.buffer + filled;
+                size_t wanted = mixBufferSize - filled;
+                AudioSource* next = nextSource(track);
                 
-                size_t bytesRead = track.stream->read(reinterpret_cast<char*>(track.buffer), samplesToRead * sizeof(int16_t));
-                track.bufferPos = 0;
+                if (track.fadeLength > 0) {
+                    filled += crossfade(track, out, wanted);
+                    if (track.fadePos >= track.fadeLength) advanceQueue(trackNum);
+                    continue;
+                }
                 
-                if (bytesRead == 0) {
-                    if(track.loop) {
-                        track.stream->seek(44);
-                         track.fadeVolume = 0;
-                    }
-                    else {
-                        stop(trackNum);
-                        return false;
+                if (next && track.crossfadeFrames > 0 && next->remaining() != AudioSource::UNKNOWN_LENGTH) {
+                    size_t left = track.source->remaining();
+                    if (left != AudioSource::UNKNOWN_LENGTH) {
+                        if (left > track.crossfadeFrames) {
+                            wanted = min(wanted, left - track.crossfadeFrames);
+                        } else if (min(left, next->remaining()) > 0) {
+                            track.fadeLength = min(left, next->remaining());
+                            track.fadePos = 0;
+                            continue;
+                        }
+                        // Nothing to fade on one side: advance gaplessly
                     }
                 }
+                
+                size_t got = track.source->read(out, wanted);
+                if (got > 0) {
+                    filled += got;
+                    rewound = false;
+                    continue;
+                }
+                
+                // Current source ended: continue with the queue, the loop, or stop
+                if (next) {
+                    advanceQueue(trackNum);
+                } else if (track.loop && !rewound && track.source->rewind()) {
+                    rewound = true;
+                    wraps = looping->getLoopCount();
+                    postEvent(trackNum, TRACK_LOOPED, filled);
+                } else {
+                    // A partial block still gets mixed; the track stops on the next tick
+                    if (filled == 0) stop(trackNum);
+                    break;
+                }
             }
             
-            // Mix samples with volume
-            for (size_t i = 0; i < mixBufferSize && track.bufferPos < mixBufferSize; i++) {
-                mixBuffer[i] += track.buffer[track.bufferPos++] * track.fadeVolume;
+            track.bufferLen = filled;
+            if (!track.isPlaying) return;
+            
+            // Sources that wrap on their own only show it in their loop count
+            if (looping && track.source == looping && looping->getLoopCount() != wraps) {
+                postEvent(trackNum, TRACK_LOOPED);
             }
-
-            if(track.fadeVolume < track.volume) {
-                track.fadeVolume += 0.1f;
+            uint32_t underruns = decodeUnderruns(track.source);
+            if (underruns != track.underruns) {
+                track.underruns = underruns;
+                postEvent(trackNum, TRACK_UNDERRUN);
             }
+        }
+        
+        // Mixes len samples with the gain ramped linearly from gainFrom to gainTo
+        // over the block; a constant gain takes the cheaper loops.
+        void mixSamples(int32_t* dst, const int16_t* src, size_t len, int32_t gainFrom, int32_t gainTo, bool first) {
+            const int32_t gain = gainTo;
             
-            return true;
+            if (gainFrom != gainTo) {
+                int32_t ramp = gainFrom << 8;
+                const int32_t step = (gainTo - gainFrom) * 256 / (int32_t)mixBufferSize;
+                if (first) {
+                    for (size_t i = 0; i < len; i++, ramp += step) dst[i] = (src[i] * (ramp >> 8)) >> 15;
+                } else {
+                    for (size_t i = 0; i < len; i++, ramp += step) dst[i] += (src[i] * (ramp >> 8)) >> 15;
+                }
+            } else if (first) {
+                if (gain == UNITY_GAIN) {
+                    for (size_t i = 0; i < len; i++) dst[i] = src[i];
+                } else {
+                    for (size_t i = 0; i < len; i++) dst[i] = (src[i] * gain) >> 15;
+                }
+            } else {
+                if (gain == UNITY_GAIN) {
+                    for (size_t i = 0; i < len; i++) dst[i] += src[i];
+                } else {
+                    for (size_t i = 0; i < len; i++) dst[i] += (src[i] * gain) >> 15;
+                }
+            }
+            
+            if (first && len < mixBufferSize) {
+                memset(dst + len, 0, (mixBufferSize - len) * sizeof(int32_t));
+            }
+        }
+        
+        // Voices on bus (-1: every bus without an effect) into dst. Each reads
+        // its block into the scratch buffer and is mixed from there; silent
+        // stretches are skipped. Returns whether dst is still unwritten.
+        bool mixVoices(int32_t* dst, int bus, bool first) {
+            for (int i = 0; i < MAX_VOICES; i++) first = mixVoice(voices[i], dst, bus, first, false);
+            for (int i = 0; i < FADING_VOICES; i++) first = mixVoice(fadingVoices[i], dst, bus, first, true);
+            return first;
+        }
+        
+        // A fading voice ramps to silence across this block and then ends
+        bool mixVoice(Voice& voice, int32_t* dst, int bus, bool first, bool fading) {
+            if (!voice.active) return first;
+            const MixBus& target = buses[voice.bus];
+            // Muted buses skip their effect pass, so their voices advance here
+            if (bus < 0 ? target.effect && !target.muted : voice.bus != bus) return first;
+            
+            if (voice.cursor.silentFrames() >= mixBufferSize) {
+                if (fading || voice.cursor.skip(mixBufferSize) == 0) voice.active = false;
+                return first;
+            }
+            size_t got = voice.cursor.read(scratchBuffer, mixBufferSize);
+            if (got == 0 || fading) voice.active = false;
+            if (got == 0 || target.muted) return first;
+            
+            int32_t gain = voice.gain;
+            int32_t from = gain;
+            int32_t to = gain;
+            if (bus < 0) {
+                int32_t level = busGain(target);
+                if (level != UNITY_GAIN) gain = (gain * level) >> 15;
+                from = duck(gain, voice.bus, true);
+                to = duck(gain, voice.bus, false);
+            }
+            mixSamples(dst, scratchBuffer, got, from, fading ? 0 : to, first);
+            return false;
+        }
+        
+        // Hands a voice about to be reused to a fading slot. With all of them
+        // busy the oldest fade is cut short instead.
+        void fadeOut(const Voice& voice) {
+            int chosen = 0;
+            for (int i = 0; i < FADING_VOICES; i++) {
+                if (!fadingVoices[i].active) {
+                    chosen = i;
+                    break;
+                }
+                if ((int32_t)(fadingVoices[i].serial - fadingVoices[chosen].serial) < 0) chosen = i;
+            }
+            fadingVoices[chosen] = voice;
+        }
+        
+        bool voicesFading() const {
+            for (int i = 0; i < FADING_VOICES; i++) {
+                if (fadingVoices[i].active) return true;
+            }
+            return false;
+        }
+        
+        void mixBus(const MixBus& bus, int32_t gainFrom, int32_t gainTo, bool first) {
+            const int32_t* src = bus.accum;
+            const int32_t gain = gainTo;
+            
+            if (gainFrom != gainTo) {
+                int32_t ramp = gainFrom << 8;
+                const int32_t step = (gainTo - gainFrom) * 256 / (int32_t)mixBufferSize;
+                for (size_t i = 0; i < mixBufferSize; i++, ramp += step) {
+                    int32_t sample = (int32_t)(((int64_t)src[i] * (ramp >> 8)) >> 15);
+                    mixAccum[i] = first ? sample : mixAccum[i] + sample;
+                }
+            } else if (first) {
+                if (gain == UNITY_GAIN) {
+                    memcpy(mixAccum, src, mixBufferSize * sizeof(int32_t));
+                } else {
+                    for (size_t i = 0; i < mixBufferSize; i++) mixAccum[i] = (int32_t)(((int64_t)src[i] * gain) >> 15);
+                }
+            } else {
+                if (gain == UNITY_GAIN) {
+                    for (size_t i = 0; i < mixBufferSize; i++) mixAccum[i] += src[i];
+                } else {
+                    for (size_t i = 0; i < mixBufferSize; i++) mixAccum[i] += (int32_t)(((int64_t)src[i] * gain) >> 15);
+                }
+            }
         }
     };
 }
\ No newline at end of file
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <Arduino.h>
+#include <async/Stream.h>
+#include <async/AudioSource.h>
+
+namespace async {
+    // 16-bit mono PCM WAV read from a Stream. The RIFF chunks are walked to
+    // find the data chunk, so files with LIST or other chunks before the
+    // samples play from the right offset and stop at the end of the data.
+    // Loop points come from the first smpl loop, or from cue points.
+    class WavSource : public AudioSource {
+    private:
+        static const size_t FADE_CHUNK = 32;
+
+        Stream* stream;
+        size_t dataOffset;
+        size_t dataFrames;
+        uint32_t sampleRate;
+        size_t position;
+        size_t loopStart;
+        size_t loopEnd;
+        size_t loopFade;
+        size_t fadeFrom;
+        bool looping;
+        uint32_t wraps;
+
+        static uint32_t readLE32(const uint8_t* p) {
+            return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+
+        static uint16_t readLE16(const uint8_t* p) {
+            return p[0] | (p[1] << 8);
+        }
+
+        bool readExact(void* dst, size_t len) {
+            return stream->read(reinterpret_cast<char*>(dst), len) == len;
+        }
+
+        void parseSampler(uint32_t size, bool& found) {
+            uint8_t smpl[36 + 24];
+            if (size < sizeof(smpl) || !readExact(smpl, sizeof(smpl))) return;
+            if (readLE32(smpl + 28) == 0) return;
+
+            // First loop; the end sample is inclusive
+            loopStart = readLE32(smpl + 36 + 8);
+            loopEnd = readLE32(smpl + 36 + 12) + 1;
+            found = true;
+        }
+
+        void parseCues(uint32_t size) {
+            uint8_t count[4];
+            if (size < sizeof(count) || !readExact(count, sizeof(count))) return;
+
+            // Earliest cue starts the loop, the next one (if any) ends it
+            size_t first = (size_t)-1;
+            size_t second = (size_t)-1;
+            uint32_t points = min(readLE32(count), (size - 4) / 24);
+            for (uint32_t i = 0; i < points; i++) {
+                uint8_t cue[24];
+                if (!readExact(cue, sizeof(cue))) return;
+                size_t offset = readLE32(cue + 20);
+                if (offset < first) {
+                    second = first;
+                    first = offset;
+                } else if (offset < second) {
+                    second = offset;
+                }
+            }
+
+            if (first == (size_t)-1) return;
+            loopStart = first;
+            if (second != (size_t)-1) loopEnd = second;
+        }
+
+        bool parseHeader(uint32_t requiredRate) {
+            uint8_t header[12];
+            if (!readExact(header, sizeof(header))) return false;
+            if (memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) return false;
+
+            bool haveFormat = false;
+            bool haveData = false;
+            bool haveSampler = false;
+            size_t offset = sizeof(header);
+
+            // Loop chunks usually follow the data, so walk to the end of the file
+            while (true) {
+                uint8_t chunk[8];
+                if (!readExact(chunk, sizeof(chunk))) break;
+                uint32_t size = readLE32(chunk + 4);
+                offset += sizeof(chunk);
+
+                if (memcmp(chunk, "fmt ", 4) == 0) {
+                    uint8_t fmt[16];
+                    if (size < sizeof(fmt) || !readExact(fmt, sizeof(fmt))) return false;
+                    // PCM, mono, 16-bit only
+                    if (readLE16(fmt) != 1 || readLE16(fmt + 2) != 1 || readLE16(fmt + 14) != 16) return false;
+                    sampleRate = readLE32(fmt + 4);
+                    haveFormat = true;
+                } else if (memcmp(chunk, "data", 4) == 0) {
+                    dataOffset = offset;
+                    dataFrames = size / sizeof(int16_t);
+                    haveData = true;
+                } else if (memcmp(chunk, "smpl", 4) == 0) {
+                    parseSampler(size, haveSampler);
+                } else if (memcmp(chunk, "cue ", 4) == 0 && !haveSampler) {
+                    parseCues(size);
+                }
+
+                offset += size + (size & 1);
+                stream->seek(offset);
+            }
+
+            if (!haveFormat || !haveData) return false;
+            if (requiredRate && sampleRate != requiredRate) return false;
+
+            if (loopEnd > dataFrames) loopEnd = dataFrames;
+            if (loopStart >= loopEnd) {
+                loopStart = 0;
+                loopEnd = dataFrames;
+            }
+
+            stream->seek(dataOffset);
+            return true;
+        }
+
+        void seekFrame(size_t frame) {
+            stream->seek(dataOffset + frame * sizeof(int16_t));
+            position = frame;
+        }
+
+        size_t readFrames(int16_t* samples, size_t frames) {
+            size_t got = stream->read(reinterpret_cast<char*>(samples), frames * sizeof(int16_t)) / sizeof(int16_t);
+            position += got;
+            return got;
+        }
+
+        // Reads inside the last loopFade frames before loopEnd, blending in the
+        // loopFade frames from fadeFrom so the wrap lands on matching material
+        size_t readFade(int16_t* samples, size_t frames) {
+            size_t fadeStart = loopEnd - loopFade;
+            size_t from = position;
+            frames = min(frames, (size_t)FADE_CHUNK);
+
+            size_t got = readFrames(samples, frames);
+            if (got == 0) return 0;
+
+            int16_t lead[FADE_CHUNK];
+            size_t leadFrom = fadeFrom + (from - fadeStart);
+            seekFrame(leadFrom);
+            size_t leadGot = readFrames(lead, got);
+            if (leadGot < got) memset(lead + leadGot, 0, (got - leadGot) * sizeof(int16_t));
+            seekFrame(from + got);
+
+            for (size_t i = 0; i < got; i++) {
+                int32_t in = (int32_t)(((from - fadeStart + i) << 15) / loopFade);
+                samples[i] = (samples[i] * ((1 << 15) - in) + lead[i] * in) >> 15;
+            }
+            return got;
+        }
+
+    public:
+        WavSource() : stream(nullptr), dataOffset(0), dataFrames(0), sampleRate(0), position(0),
+            loopStart(0), loopEnd(0), loopFade(0), fadeFrom(0), looping(false), wraps(0) {}
+
+        // With a requiredRate, files at any other rate are rejected
+        bool open(Stream* source, uint32_t requiredRate = 0) {
+            stream = source;
+            position = 0;
+            sampleRate = 0;
+            loopStart = 0;
+            loopEnd = (size_t)-1;
+            loopFade = 0;
+            fadeFrom = 0;
+            looping = false;
+            wraps = 0;
+            if (!stream) return false;
+
+            stream->seek(0);
+            if (!parseHeader(requiredRate)) {
+                stream = nullptr;
+                return false;
+            }
+            fadeFrom = loopStart;
+            return true;
+        }
+
+        uint32_t getSampleRate() const {
+            return sampleRate;
+        }
+
+        bool hasLoopPoints() const {
+            return loopStart > 0 || loopEnd < dataFrames;
+        }
+
+        size_t getLoopStart() const { return loopStart; }
+        size_t getLoopEnd() const { return loopEnd; }
+
+        // Crossfades the loop seam over up to frames samples. The tail blends
+        // into the lead-in before loopStart when there is enough of it;
+        // otherwise (e.g. loopStart 0) into the start of the loop itself,
+        // which later passes then skip, so the loop gets loopFade shorter.
+        void setLoopCrossfade(size_t frames) {
+            size_t length = loopEnd - loopStart;
+            if (frames <= loopStart) {
+                loopFade = min(frames, length);
+                fadeFrom = loopStart - loopFade;
+            } else {
+                loopFade = min(frames, length / 2);
+                fadeFrom = loopStart;
+            }
+        }
+
+        bool setLooping(bool enable) override {
+            looping = enable;
+            return true;
+        }
+
+        size_t read(int16_t* samples, size_t frames) override {
+            if (!stream) return 0;
+
+            size_t total = 0;
+            while (total < frames) {
+                // Past the loop end (looping enabled late) the whole data wraps instead
+                size_t end = looping && position <= loopEnd ? loopEnd : dataFrames;
+                if (position >= end) {
+                    if (!looping || loopEnd == 0) break;
+                    // Resumes after whatever the seam fade already played
+                    seekFrame(fadeFrom + loopFade);
+                    wraps++;
+                    continue;
+                }
+
+                size_t wanted = min(frames - total, end - position);
+                size_t got;
+                if (looping && loopFade > 0 && end == loopEnd && position >= loopEnd - loopFade) {
+                    got = readFade(samples + total, wanted);
+                } else {
+                    if (looping && loopFade > 0 && end == loopEnd) wanted = min(wanted, loopEnd - loopFade - position);
+                    got = readFrames(samples + total, wanted);
+                }
+
+                if (got == 0) break;
+                total += got;
+            }
+            return total;
+        }
+
+        uint32_t getLoopCount() const override {
+            return wraps;
+        }
+
+        size_t remaining() const override {
+            if (!stream) return 0;
+            return looping ? UNKNOWN_LENGTH : dataFrames - position;
+        }
+
+        bool rewind() override {
+            if (!stream) return false;
+            seekFrame(0);
+            wraps = 0;
+            return true;
+        }
+    };
+}
@@ -1,4 +1,4 @@
-const unsigned char audioHex[] = {0x52, 0x49, 0x46, 0x46, 0x46, 0xE2, 0x04, 0x00, 0x57, 0x41, 0x56, 0x45, 0x66, 0x6D, 0x74, 0x20, 
+constexpr unsigned char audioHex[] = {0x52, 0x49, 0x46, 0x46, 0x46, 0xE2, 0x04, 0x00, 0x57, 0x41, 0x56, 0x45, 0x66, 0x6D, 0x74, 0x20, 
 0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x7D, 0x00, 0x00, 0x00, 0xFA, 0x00, 0x00, 
 0x02, 0x00, 0x10, 0x00, 0x4C, 0x49, 0x53, 0x54, 0x1A, 0x00, 0x00, 0x00, 0x49, 0x4E, 0x46, 0x4F, 
 0x49, 0x53, 0x46, 0x54, 0x0D, 0x00, 0x00, 0x00, 0x4C, 0x61, 0x76, 0x66, 0x36, 0x30, 0x2E, 0x33, 
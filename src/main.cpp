@@ -1,12 +1,14 @@
 // #include <Arduino.h>
 // #include <async/WavPlayer.h>
 // #include <async/Executor.h>
-// #include <async/ByteStream.h>
+// #include <async/WavAsset.h>
 // #include "audio_file.cpp"
 
 
 // using namespace async;
 
+// WAV_ASSET(audio, audioHex);
+
 // Executor executor;
 // WavPlayer player(19, 22, 25);
 
@@ -20,12 +22,12 @@
 
 //   player.setVolume(0, 0.5);
 
-//   player.play(0, new ByteStream(audioHex, sizeof(audioHex)));
+//   player.play(0, audio);
 
 //   player.onEvent([](int trackNum, WavPlayerEvent event) {
 //     Serial.println(event);
 //     if(event == TRACK_STOPPED) {
-//         player.play(0, new ByteStream(audioHex, sizeof(audioHex)));
+//         player.play(0, audio);
 //     }
 //   });
 // }
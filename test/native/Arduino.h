@@ -0,0 +1,25 @@
+#pragma once
+
+// Just enough of the Arduino core for the host (env:native) tests to
+// compile the headers they cover
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+template <typename T>
+inline T min(T a, T b) {
+    return b < a ? b : a;
+}
+
+template <typename T>
+inline T max(T a, T b) {
+    return a < b ? b : a;
+}
+
+template <typename T>
+inline T constrain(T value, T low, T high) {
+    return value < low ? low : high < value ? high : value;
+}
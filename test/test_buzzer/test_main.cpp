@@ -0,0 +1,90 @@
+#include <unity.h>
+#include <async/Buzzer.h>
+
+using namespace async;
+
+static HostBuzzerOutput output;
+static Buzzer* buzzer;
+
+static const BuzzerNote melody[] = {
+    {440, 100},
+    {0, 50},
+    {880, 200}
+};
+
+void setUp() {
+    output = HostBuzzerOutput();
+    static Buzzer instance(&output);
+    buzzer = &instance;
+    buzzer->stop();
+    buzzer->setGap(30);
+}
+
+void tearDown() {}
+
+static void step(uint32_t ms) {
+    output.advance(ms);
+    buzzer->tick();
+}
+
+void test_notes_and_gaps_follow_their_durations() {
+    buzzer->play(melody, 3);
+    TEST_ASSERT_EQUAL_UINT32(440, output.currentFrequency());
+
+    step(99);
+    TEST_ASSERT_EQUAL_UINT32(440, output.currentFrequency());
+    step(1);
+    TEST_ASSERT_EQUAL_UINT32(0, output.currentFrequency());     // 30 ms gap
+
+    step(30);                                                    // rest, then its 15 ms gap
+    TEST_ASSERT_EQUAL_UINT32(0, output.currentFrequency());
+    step(64);
+    TEST_ASSERT_EQUAL_UINT32(0, output.currentFrequency());
+    step(1);
+    TEST_ASSERT_EQUAL_UINT32(880, output.currentFrequency());
+
+    step(200 + 60);
+    TEST_ASSERT_FALSE(buzzer->isPlaying());
+    TEST_ASSERT_EQUAL_UINT32(0, output.currentFrequency());
+}
+
+void test_late_ticks_do_not_drift() {
+    buzzer->setGap(0);
+    buzzer->play(melody, 3, true);
+
+    // One tick far past several deadlines lands on the note scheduled for that time
+    step(100 + 50 + 200 + 20);
+    TEST_ASSERT_TRUE(buzzer->isPlaying());
+    TEST_ASSERT_EQUAL_UINT32(440, output.currentFrequency());
+    step(79);
+    TEST_ASSERT_EQUAL_UINT32(440, output.currentFrequency());
+    step(1);
+    TEST_ASSERT_EQUAL_UINT32(0, output.currentFrequency());
+}
+
+void test_end_without_gap_silences_the_last_note() {
+    buzzer->setGap(0);
+    buzzer->tone(1000, 40);
+    TEST_ASSERT_EQUAL_UINT32(1000, output.currentFrequency());
+
+    step(40);
+    TEST_ASSERT_FALSE(buzzer->isPlaying());
+    TEST_ASSERT_EQUAL_UINT32(0, output.currentFrequency());
+}
+
+void test_zero_length_notes_do_not_hang() {
+    static const BuzzerNote empty[] = {{440, 0}, {880, 0}};
+    buzzer->play(empty, 2, true);
+    step(0);
+    step(1);
+    TEST_ASSERT_TRUE(buzzer->isPlaying());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_notes_and_gaps_follow_their_durations);
+    RUN_TEST(test_late_ticks_do_not_drift);
+    RUN_TEST(test_end_without_gap_silences_the_last_note);
+    RUN_TEST(test_zero_length_notes_do_not_hang);
+    return UNITY_END();
+}
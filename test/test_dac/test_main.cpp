@@ -0,0 +1,104 @@
+#include <unity.h>
+#include <math.h>
+#include <vector>
+#include <async/DacDither.h>
+
+using namespace async;
+
+static const int FRAMES = 4096;
+static const float RATE = 32000;
+
+static std::vector<int16_t> sine(float frequency, float amplitude) {
+    std::vector<int16_t> samples(FRAMES);
+    for (int i = 0; i < FRAMES; i++) {
+        samples[i] = (int16_t)lrintf(amplitude * sinf(2 * (float)M_PI * frequency * i / RATE));
+    }
+    return samples;
+}
+
+static std::vector<uint16_t> convert(const std::vector<int16_t>& samples, bool shaping) {
+    std::vector<uint16_t> out(samples.size() * 2);
+    DacDither state(shaping);
+    // In blocks, like the player, so the state is carried across
+    for (size_t i = 0; i < samples.size(); i += 512) {
+        packDac(samples.data() + i, out.data() + i * 2, 512, state);
+    }
+    return out;
+}
+
+// Signal to requantization noise in dB below maxFrequency, from a
+// Hann-windowed DFT of the error
+static double snr(const std::vector<int16_t>& input, const std::vector<uint16_t>& out, float maxFrequency) {
+    std::vector<double> error(FRAMES);
+    double signal = 0;
+    for (int i = 0; i < FRAMES; i++) {
+        double window = 0.5 - 0.5 * cos(2 * M_PI * i / FRAMES);
+        error[i] = ((double)out[i * 2] - 32768 - input[i]) * window;
+        signal += (double)input[i] * input[i] * window * window;
+    }
+
+    double noise = 0;
+    for (int k = 0; k * RATE / FRAMES < maxFrequency; k++) {
+        double re = 0;
+        double im = 0;
+        for (int i = 0; i < FRAMES; i++) {
+            re += error[i] * cos(2 * M_PI * k * i / FRAMES);
+            im -= error[i] * sin(2 * M_PI * k * i / FRAMES);
+        }
+        noise += (re * re + im * im) * 2 / FRAMES;
+    }
+    return 10 * log10(signal / noise);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_noise_shaping_lowers_in_band_noise() {
+    std::vector<int16_t> input = sine(997, 8000);
+    double shaped = snr(input, convert(input, true), 2000);
+    double rounded = snr(input, convert(input, false), 2000);
+    TEST_ASSERT_TRUE(shaped > 50);
+    TEST_ASSERT_TRUE(shaped > rounded + 6);
+}
+
+void test_both_channels_carry_the_sample() {
+    std::vector<int16_t> input = sine(440, 12000);
+    std::vector<uint16_t> out = convert(input, true);
+    for (int i = 0; i < FRAMES; i++) {
+        TEST_ASSERT_EQUAL_UINT32(out[i * 2], out[i * 2 + 1]);
+        TEST_ASSERT_EQUAL_UINT32(0, out[i * 2] & 0xFF);
+    }
+}
+
+void test_rounding_without_shaping() {
+    const int16_t input[4] = {0, 127, 128, -32768};
+    uint16_t out[8];
+    DacDither state(false);
+    packDac(input, out, 4, state);
+    TEST_ASSERT_EQUAL_UINT32(0x8000, out[0]);
+    TEST_ASSERT_EQUAL_UINT32(0x8000, out[2]);
+    TEST_ASSERT_EQUAL_UINT32(0x8100, out[4]);
+    TEST_ASSERT_EQUAL_UINT32(0x0000, out[6]);
+    TEST_ASSERT_EQUAL_INT(0, state.error);
+}
+
+void test_clipping_does_not_wind_up_the_error() {
+    std::vector<int16_t> input(FRAMES, 32767);
+    for (int i = FRAMES / 2; i < FRAMES; i++) input[i] = 0;
+    std::vector<uint16_t> out = convert(input, true);
+
+    // Back to dithered silence right after the clipped half
+    for (int i = FRAMES / 2 + 2; i < FRAMES; i++) {
+        TEST_ASSERT_INT_WITHIN(0x300, 0x8000, out[i * 2]);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_noise_shaping_lowers_in_band_noise);
+    RUN_TEST(test_both_channels_carry_the_sample);
+    RUN_TEST(test_rounding_without_shaping);
+    RUN_TEST(test_clipping_does_not_wind_up_the_error);
+    return UNITY_END();
+}
@@ -0,0 +1,249 @@
+#include <unity.h>
+#include <vector>
+#include <async/QoaSource.h>
+
+using namespace async;
+
+// Reference QOA encoder (qoaformat.org), kept to what the round trip needs
+namespace encoder {
+    static const int32_t scalefactors[16] = {
+        1, 7, 21, 45, 84, 138, 211, 304, 421, 562, 731, 928, 1157, 1419, 1715, 2048
+    };
+    static const int quantize[17] = {7, 7, 7, 5, 5, 3, 3, 1, 0, 0, 2, 2, 4, 4, 6, 6, 6};
+    static const float dequantize[8] = {0.75f, -0.75f, 2.5f, -2.5f, 4.5f, -4.5f, 7.0f, -7.0f};
+
+    struct Lms {
+        int32_t history[4];
+        int32_t weights[4];
+
+        int32_t predict() const {
+            int32_t predicted = 0;
+            for (int i = 0; i < 4; i++) predicted += weights[i] * history[i];
+            return predicted >> 13;
+        }
+
+        void update(int32_t sample, int32_t residual) {
+            int32_t delta = residual >> 4;
+            for (int i = 0; i < 4; i++) weights[i] += history[i] < 0 ? -delta : delta;
+            for (int i = 0; i < 3; i++) history[i] = history[i + 1];
+            history[3] = sample;
+        }
+    };
+
+    static int32_t clamp(int32_t value, int32_t low, int32_t high) {
+        return value < low ? low : value > high ? high : value;
+    }
+
+    static int32_t dequantized(int scalefactor, int quantized) {
+        float value = scalefactors[scalefactor] * dequantize[quantized];
+        return value < 0 ? -(int32_t)floorf(-value + 0.5f) : (int32_t)floorf(value + 0.5f);
+    }
+
+    static int32_t divide(int32_t value, int scalefactor) {
+        int32_t reciprocal = (65536 + scalefactors[scalefactor] - 1) / scalefactors[scalefactor];
+        int32_t n = (value * reciprocal + (1 << 15)) >> 16;
+        return n + ((value > 0) - (value < 0)) - ((n > 0) - (n < 0));
+    }
+
+    static void put(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+        for (int i = bytes - 1; i >= 0; i--) out.push_back((uint8_t)(value >> (i * 8)));
+    }
+
+    static std::vector<uint8_t> encode(const std::vector<int16_t>& samples, uint32_t rate, int channels) {
+        const int FRAME = QoaSource::SLICES_PER_FRAME * QoaSource::SLICE_LEN;
+        size_t frames = samples.size() / channels;
+        std::vector<uint8_t> out = {'q', 'o', 'a', 'f'};
+        put(out, frames, 4);
+
+        Lms lms[QoaSource::MAX_CHANNELS];
+        int previous[QoaSource::MAX_CHANNELS] = {0, 0};
+        for (int c = 0; c < channels; c++) lms[c] = {{0, 0, -1, 2}, {0, 0, -(1 << 13), 1 << 14}};
+
+        for (size_t start = 0; start < frames; start += FRAME) {
+            size_t length = min(frames - start, (size_t)FRAME);
+            size_t slices = (length + QoaSource::SLICE_LEN - 1) / QoaSource::SLICE_LEN;
+            put(out, channels, 1);
+            put(out, rate, 3);
+            put(out, length, 2);
+            put(out, 8 + channels * 16 + slices * 8 * channels, 2);
+            for (int c = 0; c < channels; c++) {
+                for (int i = 0; i < 4; i++) put(out, (uint16_t)lms[c].history[i], 2);
+                for (int i = 0; i < 4; i++) put(out, (uint16_t)lms[c].weights[i], 2);
+            }
+
+            for (size_t slice = start; slice < start + length; slice += QoaSource::SLICE_LEN) {
+                size_t count = min(start + length - slice, (size_t)QoaSource::SLICE_LEN);
+                for (int c = 0; c < channels; c++) {
+                    uint64_t bestError = UINT64_MAX;
+                    uint64_t bestBits = 0;
+                    int bestScale = 0;
+                    Lms bestLms = lms[c];
+
+                    // Every scalefactor, starting from the last one used
+                    for (int tried = 0; tried < 16; tried++) {
+                        int scale = (tried + previous[c]) % 16;
+                        Lms state = lms[c];
+                        uint64_t bits = scale;
+                        uint64_t error = 0;
+                        for (size_t i = slice; i < slice + count && error < bestError; i++) {
+                            int32_t sample = samples[i * channels + c];
+                            int32_t predicted = state.predict();
+                            int quantized = quantize[clamp(divide(sample - predicted, scale), -8, 8) + 8];
+                            int32_t residual = dequantized(scale, quantized);
+                            int32_t decoded = clamp(predicted + residual, INT16_MIN, INT16_MAX);
+                            error += (uint64_t)((sample - decoded) * (int64_t)(sample - decoded));
+                            state.update(decoded, residual);
+                            bits = (bits << 3) | quantized;
+                        }
+                        if (error < bestError) {
+                            bestError = error;
+                            bestBits = bits;
+                            bestScale = scale;
+                            bestLms = state;
+                        }
+                    }
+
+                    previous[c] = bestScale;
+                    lms[c] = bestLms;
+                    put(out, bestBits << ((QoaSource::SLICE_LEN - count) * 3), 8);
+                }
+            }
+        }
+        return out;
+    }
+}
+
+class MemoryStream : public Stream {
+private:
+    const std::vector<uint8_t>& data;
+    size_t position;
+
+public:
+    MemoryStream(const std::vector<uint8_t>& bytes) : data(bytes), position(0) {}
+
+    size_t read(char* buffer, size_t length) override {
+        length = min(length, data.size() - position);
+        memcpy(buffer, data.data() + position, length);
+        position += length;
+        return length;
+    }
+
+    bool seek(size_t offset) override {
+        if (offset > data.size()) return false;
+        position = offset;
+        return true;
+    }
+};
+
+static std::vector<int16_t> signal(size_t frames, int channels) {
+    std::vector<int16_t> samples;
+    uint32_t seed = 1;
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            seed = seed * 1664525 + 1013904223;
+            float t = (float)i / 32000;
+            float value = 12000 * sinf(2 * (float)M_PI * 440 * t + c) + 3000 * sinf(2 * (float)M_PI * 3000 * t)
+                + (int32_t)(seed >> 22) - 512;
+            samples.push_back((int16_t)value);
+        }
+    }
+    return samples;
+}
+
+static std::vector<int16_t> decodeAll(QoaSource& source) {
+    std::vector<int16_t> decoded;
+    int16_t buffer[333];
+    size_t got;
+    while ((got = source.read(buffer, 333)) > 0) decoded.insert(decoded.end(), buffer, buffer + got);
+    return decoded;
+}
+
+// Signal to noise ratio in dB of the decoded mono mix against the input
+static float snr(const std::vector<int16_t>& input, const std::vector<int16_t>& decoded, int channels) {
+    double power = 0;
+    double noise = 0;
+    for (size_t i = 0; i < decoded.size(); i++) {
+        int32_t mix = 0;
+        for (int c = 0; c < channels; c++) mix += input[i * channels + c];
+        mix /= channels;
+        power += (double)mix * mix;
+        noise += (double)(mix - decoded[i]) * (mix - decoded[i]);
+    }
+    return (float)(10 * log10(power / noise));
+}
+
+static void roundTrip(int channels) {
+    // Not a whole number of frames or slices
+    const size_t frames = 12345;
+    std::vector<int16_t> input = signal(frames, channels);
+    std::vector<uint8_t> file = encoder::encode(input, 32000, channels);
+
+    MemoryStream stream(file);
+    QoaSource source;
+    TEST_ASSERT_TRUE(source.open(&stream));
+    TEST_ASSERT_EQUAL_UINT32(32000, source.getSampleRate());
+    TEST_ASSERT_EQUAL_UINT32(channels, source.getChannels());
+    TEST_ASSERT_EQUAL_UINT32(frames, source.remaining());
+
+    std::vector<int16_t> decoded = decodeAll(source);
+    TEST_ASSERT_EQUAL_UINT32(frames, decoded.size());
+    TEST_ASSERT_EQUAL_UINT32(0, source.remaining());
+    TEST_ASSERT_TRUE(snr(input, decoded, channels) > 30.0f);
+
+    // A second pass decodes the same samples
+    TEST_ASSERT_TRUE(source.rewind());
+    std::vector<int16_t> again = decodeAll(source);
+    TEST_ASSERT_TRUE(again == decoded);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_mono_round_trip() {
+    roundTrip(1);
+}
+
+void test_stereo_round_trip_mixes_down() {
+    roundTrip(2);
+}
+
+void test_truncated_file_stops_early() {
+    std::vector<int16_t> input = signal(6000, 1);
+    std::vector<uint8_t> file = encoder::encode(input, 32000, 1);
+    file.resize(file.size() - 100);
+
+    MemoryStream stream(file);
+    QoaSource source;
+    TEST_ASSERT_TRUE(source.open(&stream));
+    std::vector<int16_t> decoded = decodeAll(source);
+    TEST_ASSERT_TRUE(decoded.size() < input.size());
+    TEST_ASSERT_TRUE(decoded.size() > 5000);
+}
+
+void test_rejects_other_files() {
+    std::vector<uint8_t> file = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E'};
+    MemoryStream stream(file);
+    QoaSource source;
+    TEST_ASSERT_FALSE(source.open(&stream));
+    TEST_ASSERT_EQUAL_UINT32(0, source.read(nullptr, 10));
+}
+
+void test_rejects_other_rates() {
+    std::vector<int16_t> input = signal(1000, 1);
+    std::vector<uint8_t> file = encoder::encode(input, 22050, 1);
+    MemoryStream stream(file);
+    QoaSource source;
+    TEST_ASSERT_FALSE(source.open(&stream, 32000));
+    TEST_ASSERT_TRUE(source.open(&stream, 22050));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_mono_round_trip);
+    RUN_TEST(test_stereo_round_trip_mixes_down);
+    RUN_TEST(test_truncated_file_stops_early);
+    RUN_TEST(test_rejects_other_files);
+    RUN_TEST(test_rejects_other_rates);
+    return UNITY_END();
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Packs mono 16-bit PCM WAV files into a sound bank for async::SoundBank.
+
+    soundbank.py -o sounds.bin 1=click.wav 2=coin.wav 10=music.wav
+
+Ids are unsigned 32-bit. Loop points come from the file's smpl chunk.
+Leading and trailing silence is cut from the payload and only recorded in the
+directory (--keep-silence stores it as is). On ESP32 flash the result into a
+data partition, e.g. with the partition table entry
+
+    sounds, data, 0x40, , 1M
+
+and `parttool.py write_partition --partition-name sounds --input sounds.bin`.
+"""
+
+import argparse
+import struct
+import sys
+
+VERSION = 1
+HEADER_SIZE = 16
+ENTRY_SIZE = 40
+SOUND_PCM16 = 1
+
+
+def read_wav(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[0:4] != b'RIFF' or data[8:12] != b'WAVE':
+        raise ValueError(f'{path}: not a RIFF/WAVE file')
+
+    fmt = pcm = None
+    loop = (0, 0)
+    offset = 12
+    while offset + 8 <= len(data):
+        chunk, size = struct.unpack_from('<4sI', data, offset)
+        body = data[offset + 8:offset + 8 + size]
+        if chunk == b'fmt ':
+            fmt = struct.unpack_from('<HHIIHH', body)
+        elif chunk == b'data':
+            pcm = body
+        elif chunk == b'smpl' and len(body) >= 60 and struct.unpack_from('<I', body, 28)[0] > 0:
+            start, end = struct.unpack_from('<II', body, 44)
+            loop = (start, end + 1)
+        offset += 8 + size + (size & 1)
+
+    if fmt is None or pcm is None:
+        raise ValueError(f'{path}: missing fmt or data chunk')
+    tag, channels, rate, _, _, bits = fmt
+    if tag != 1 or channels != 1 or bits != 16:
+        raise ValueError(f'{path}: only mono 16-bit PCM is supported')
+    return rate, pcm, loop
+
+
+def trim(pcm):
+    """Returns (leading silent frames, audible pcm, trailing silent frames)."""
+    frames = len(pcm) // 2
+    samples = struct.unpack(f'<{frames}h', pcm[:frames * 2])
+    start = 0
+    while start < frames and samples[start] == 0:
+        start += 1
+    end = frames
+    while end > start and samples[end - 1] == 0:
+        end -= 1
+    return start, pcm[start * 2:end * 2], frames - end
+
+
+def pack(sounds, alignment, keep_silence=False):
+    sounds = sorted(sounds, key=lambda s: s[0])
+    ids = [s[0] for s in sounds]
+    if len(set(ids)) != len(ids):
+        raise ValueError('duplicate sound ids')
+
+    def align(value):
+        return (value + alignment - 1) // alignment * alignment
+
+    directory = b''
+    payloads = b''
+    offset = align(HEADER_SIZE + ENTRY_SIZE * len(sounds))
+    for sound_id, rate, pcm, (loop_start, loop_end) in sounds:
+        leading, pcm, trailing = (0, pcm, 0) if keep_silence else trim(pcm)
+        start = align(offset + len(payloads))
+        payloads += b'\0' * (start - offset - len(payloads)) + pcm
+        directory += struct.pack('<IHHIIIIIIII', sound_id, SOUND_PCM16, 1, rate, start, len(pcm),
+                                 loop_start, loop_end, leading, trailing, 0)
+
+    total = offset + len(payloads)
+    header = struct.pack('<4sHHII', b'SBNK', VERSION, len(sounds), total, alignment)
+    padding = b'\0' * (offset - HEADER_SIZE - len(directory))
+    return header + directory + padding + payloads
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('sounds', nargs='+', metavar='ID=FILE.wav')
+    parser.add_argument('-o', '--output', required=True)
+    parser.add_argument('--align', type=int, default=4, help='payload alignment in bytes')
+    parser.add_argument('--keep-silence', action='store_true', help='store leading/trailing silence')
+    args = parser.parse_args()
+
+    sounds = []
+    for item in args.sounds:
+        sound_id, _, path = item.partition('=')
+        rate, pcm, loop = read_wav(path)
+        sounds.append((int(sound_id, 0), rate, pcm, loop))
+
+    bank = pack(sounds, args.align, args.keep_silence)
+    with open(args.output, 'wb') as f:
+        f.write(bank)
+    print(f'{args.output}: {len(sounds)} sounds, {len(bank)} bytes', file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()